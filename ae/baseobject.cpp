@@ -26,7 +26,8 @@ namespace ae {
 // Constructor
 _BaseObject::_BaseObject() :
 	NetworkID(0),
-	Deleted(false) {
+	Deleted(false),
+	ParallelUpdate(false) {
 
 }
 
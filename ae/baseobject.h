@@ -37,6 +37,11 @@ class _BaseObject {
 		NetworkIDType NetworkID;
 		bool Deleted;
 
+		// Allow Update to run on a worker thread when the manager has a job system.
+		// The update may only modify this object, may read other objects that aren't
+		// modified during the frame, and must not create or look up managed objects.
+		bool ParallelUpdate;
+
 	protected:
 
 };
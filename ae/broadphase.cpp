@@ -0,0 +1,573 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#include <ae/broadphase.h>
+#include <algorithm>
+#include <cmath>
+
+namespace ae {
+
+// Cell coordinates are clamped to this so cell math can't overflow
+const float HASHGRID_MAX_CELL = 1073741824.0f;
+
+// Add a collider
+void _Broadphase::Insert(NetworkIDType ID, const glm::vec4 &AABB, int CollisionMask, int CollisionGroup) {
+	if(ID >= Proxies.size())
+		Proxies.resize((std::size_t)ID + 1);
+
+	_BroadphaseProxy &Proxy = Proxies[ID];
+	if(!Proxy.Active)
+		Count++;
+
+	Proxy.AABB = AABB;
+	Proxy.CollisionMask = CollisionMask;
+	Proxy.CollisionGroup = CollisionGroup;
+	Proxy.Active = true;
+}
+
+// Update a collider's bounds
+void _Broadphase::Move(NetworkIDType ID, const glm::vec4 &AABB) {
+	if(!Contains(ID))
+		return;
+
+	Proxies[ID].AABB = AABB;
+}
+
+// Remove a collider
+void _Broadphase::Remove(NetworkIDType ID) {
+	if(!Contains(ID))
+		return;
+
+	Proxies[ID] = _BroadphaseProxy();
+	Count--;
+}
+
+// Remove all colliders
+void _Broadphase::Clear() {
+	Proxies.clear();
+	Count = 0;
+}
+
+// Add a collider
+void _HashGrid::Insert(NetworkIDType ID, const glm::vec4 &AABB, int CollisionMask, int CollisionGroup) {
+	_Broadphase::Insert(ID, AABB, CollisionMask, CollisionGroup);
+	MarkChanged(ID);
+}
+
+// Update a collider's bounds, it's only rebinned if it covers different cells
+void _HashGrid::Move(NetworkIDType ID, const glm::vec4 &AABB) {
+	if(!Contains(ID))
+		return;
+
+	_Broadphase::Move(ID, AABB);
+	if(!Ranges[ID].Changed && GetRange(AABB) != Ranges[ID])
+		MarkChanged(ID);
+}
+
+// Remove a collider
+void _HashGrid::Remove(NetworkIDType ID) {
+	if(!Contains(ID))
+		return;
+
+	_Broadphase::Remove(ID);
+	MarkChanged(ID);
+}
+
+// Remove all colliders
+void _HashGrid::Clear() {
+	_Broadphase::Clear();
+	Entries.clear();
+	Ranges.clear();
+	ChangedIDs.clear();
+	LargeIDs.clear();
+}
+
+// Queue a collider to be rebinned
+void _HashGrid::MarkChanged(NetworkIDType ID) {
+	if(ID >= Ranges.size())
+		Ranges.resize((std::size_t)ID + 1);
+
+	if(Ranges[ID].Changed)
+		return;
+
+	Ranges[ID].Changed = true;
+	ChangedIDs.push_back(ID);
+}
+
+// Get cell coordinate, clamped so huge and non-finite values stay in range
+int32_t _HashGrid::GetCell(float Value) const {
+	float Cell = std::floor(Value / CellSize);
+	if(!(Cell >= -HASHGRID_MAX_CELL))
+		return (int32_t)-HASHGRID_MAX_CELL;
+	if(Cell > HASHGRID_MAX_CELL)
+		return (int32_t)HASHGRID_MAX_CELL;
+
+	return (int32_t)Cell;
+}
+
+// Get the cells an AABB covers
+_HashGrid::_CellRange _HashGrid::GetRange(const glm::vec4 &AABB) const {
+	_CellRange Range;
+	Range.StartX = GetCell(AABB[0]);
+	Range.StartY = GetCell(AABB[1]);
+	Range.EndX = GetCell(AABB[2]);
+	Range.EndY = GetCell(AABB[3]);
+
+	bool Finite = std::isfinite(AABB[0]) && std::isfinite(AABB[1]) && std::isfinite(AABB[2]) && std::isfinite(AABB[3]);
+	Range.Large = !Finite || ((double)Range.EndX - Range.StartX + 1) * ((double)Range.EndY - Range.StartY + 1) > MaxCells;
+
+	return Range;
+}
+
+// Rebin colliders that changed cells and merge their entries into the sorted list
+void _HashGrid::UpdateCells() {
+	if(ChangedIDs.empty())
+		return;
+
+	// Drop old entries
+	Entries.erase(std::remove_if(Entries.begin(), Entries.end(), [this](const _CellEntry &Entry) { return Ranges[Entry.ID].Changed; }), Entries.end());
+	LargeIDs.erase(std::remove_if(LargeIDs.begin(), LargeIDs.end(), [this](NetworkIDType ID) { return Ranges[ID].Changed; }), LargeIDs.end());
+
+	// Add entries for every cell each collider touches
+	NewEntries.clear();
+	for(const auto &ID : ChangedIDs) {
+		Ranges[ID] = Contains(ID) ? GetRange(Proxies[ID].AABB) : _CellRange();
+		const _CellRange &Range = Ranges[ID];
+		if(Range.Large) {
+			LargeIDs.push_back(ID);
+			continue;
+		}
+
+		for(int32_t Y = Range.StartY; Y <= Range.EndY; Y++) {
+			for(int32_t X = Range.StartX; X <= Range.EndX; X++)
+				NewEntries.push_back({ HashCell(X, Y), X, Y, ID });
+		}
+	}
+	ChangedIDs.clear();
+
+	std::sort(NewEntries.begin(), NewEntries.end(), CompareEntries);
+	std::size_t Middle = Entries.size();
+	Entries.insert(Entries.end(), NewEntries.begin(), NewEntries.end());
+	std::inplace_merge(Entries.begin(), Entries.begin() + (std::ptrdiff_t)Middle, Entries.end(), CompareEntries);
+}
+
+// Bin colliders into cells, then test pairs that share a cell
+void _HashGrid::FindPairs(std::vector<_BroadphasePair> &Pairs) {
+	Pairs.clear();
+	UpdateCells();
+
+	// Test pairs in each cell
+	for(std::size_t Start = 0; Start < Entries.size(); ) {
+		std::size_t End = Start + 1;
+		while(End < Entries.size() && Entries[End].Hash == Entries[Start].Hash && Entries[End].X == Entries[Start].X && Entries[End].Y == Entries[Start].Y)
+			End++;
+
+		int32_t CellX = Entries[Start].X;
+		int32_t CellY = Entries[Start].Y;
+		for(std::size_t i = Start; i < End; i++) {
+			const _BroadphaseProxy &ProxyA = Proxies[Entries[i].ID];
+			for(std::size_t j = i + 1; j < End; j++) {
+				const _BroadphaseProxy &ProxyB = Proxies[Entries[j].ID];
+				if(!Overlaps(ProxyA.AABB, ProxyB.AABB) || !ShouldCollide(ProxyA, ProxyB))
+					continue;
+
+				// Only report the pair from the cell holding the overlap's min corner
+				if(GetCell(std::max(ProxyA.AABB[0], ProxyB.AABB[0])) != CellX || GetCell(std::max(ProxyA.AABB[1], ProxyB.AABB[1])) != CellY)
+					continue;
+
+				Pairs.push_back({ Entries[i].ID, Entries[j].ID });
+			}
+		}
+
+		Start = End;
+	}
+
+	// Test large colliders against everything, pairs of large colliders are found from the lower id
+	for(const auto &ID : LargeIDs) {
+		const _BroadphaseProxy &ProxyA = Proxies[ID];
+		for(std::size_t i = 0; i < Proxies.size(); i++) {
+			const _BroadphaseProxy &ProxyB = Proxies[i];
+			if(!ProxyB.Active || i == ID || (Ranges[i].Large && i < ID))
+				continue;
+
+			if(Overlaps(ProxyA.AABB, ProxyB.AABB) && ShouldCollide(ProxyA, ProxyB))
+				Pairs.push_back({ std::min(ID, (NetworkIDType)i), std::max(ID, (NetworkIDType)i) });
+		}
+	}
+}
+
+// Get colliders overlapping an AABB
+void _HashGrid::Query(const glm::vec4 &AABB, std::vector<NetworkIDType> &Results) {
+	Results.clear();
+	UpdateCells();
+
+	int32_t StartX = GetCell(AABB[0]);
+	int32_t StartY = GetCell(AABB[1]);
+	int32_t EndX = GetCell(AABB[2]);
+	int32_t EndY = GetCell(AABB[3]);
+
+	// Scanning every collider is cheaper than visiting more cells than there are entries
+	if(EndX < StartX || EndY < StartY || ((double)EndX - StartX + 1) * ((double)EndY - StartY + 1) > (double)Entries.size()) {
+		for(std::size_t i = 0; i < Proxies.size(); i++) {
+			if(Proxies[i].Active && Overlaps(Proxies[i].AABB, AABB))
+				Results.push_back((NetworkIDType)i);
+		}
+
+		return;
+	}
+
+	for(int32_t Y = StartY; Y <= EndY; Y++) {
+		for(int32_t X = StartX; X <= EndX; X++) {
+			_CellEntry Key = { HashCell(X, Y), X, Y, 0 };
+			auto Iterator = std::lower_bound(Entries.begin(), Entries.end(), Key, CompareEntries);
+			for(; Iterator != Entries.end() && Iterator->Hash == Key.Hash && Iterator->X == X && Iterator->Y == Y; ++Iterator) {
+				const _BroadphaseProxy &Proxy = Proxies[Iterator->ID];
+				if(!Overlaps(Proxy.AABB, AABB))
+					continue;
+
+				// Only report the collider from the cell holding the overlap's min corner
+				if(GetCell(std::max(Proxy.AABB[0], AABB[0])) != X || GetCell(std::max(Proxy.AABB[1], AABB[1])) != Y)
+					continue;
+
+				Results.push_back(Iterator->ID);
+			}
+		}
+	}
+
+	for(const auto &ID : LargeIDs) {
+		if(Overlaps(Proxies[ID].AABB, AABB))
+			Results.push_back(ID);
+	}
+}
+
+// Constructor
+_AABBTree::_AABBTree(float Margin) :
+	Root(-1),
+	FreeList(-1),
+	Margin(Margin) {
+
+}
+
+// Add a collider
+void _AABBTree::Insert(NetworkIDType ID, const glm::vec4 &AABB, int CollisionMask, int CollisionGroup) {
+	if(Contains(ID))
+		Remove(ID);
+
+	_Broadphase::Insert(ID, AABB, CollisionMask, CollisionGroup);
+
+	// Add fattened leaf
+	int Leaf = AllocateNode();
+	Nodes[Leaf].AABB = AABB + glm::vec4(-Margin, -Margin, Margin, Margin);
+	Nodes[Leaf].ID = ID;
+	Proxies[ID].Node = Leaf;
+	InsertLeaf(Leaf);
+}
+
+// Update a collider, reinserting it if it left its fattened bounds
+void _AABBTree::Move(NetworkIDType ID, const glm::vec4 &AABB) {
+	if(!Contains(ID))
+		return;
+
+	_Broadphase::Move(ID, AABB);
+
+	int Leaf = Proxies[ID].Node;
+	if(ContainsAABB(Nodes[Leaf].AABB, AABB))
+		return;
+
+	RemoveLeaf(Leaf);
+	Nodes[Leaf].AABB = AABB + glm::vec4(-Margin, -Margin, Margin, Margin);
+	InsertLeaf(Leaf);
+}
+
+// Remove a collider
+void _AABBTree::Remove(NetworkIDType ID) {
+	if(!Contains(ID))
+		return;
+
+	int Leaf = Proxies[ID].Node;
+	RemoveLeaf(Leaf);
+	FreeNode(Leaf);
+
+	_Broadphase::Remove(ID);
+}
+
+// Remove all colliders
+void _AABBTree::Clear() {
+	_Broadphase::Clear();
+	Nodes.clear();
+	Root = -1;
+	FreeList = -1;
+}
+
+// Query the tree with each collider
+void _AABBTree::FindPairs(std::vector<_BroadphasePair> &Pairs) {
+	Pairs.clear();
+	if(Root == -1)
+		return;
+
+	for(std::size_t i = 0; i < Proxies.size(); i++) {
+		const _BroadphaseProxy &ProxyA = Proxies[i];
+		if(!ProxyA.Active)
+			continue;
+
+		Stack.clear();
+		Stack.push_back(Root);
+		while(!Stack.empty()) {
+			const _Node &Node = Nodes[Stack.back()];
+			Stack.pop_back();
+			if(!Overlaps(Node.AABB, ProxyA.AABB))
+				continue;
+
+			if(!Node.IsLeaf()) {
+				Stack.push_back(Node.Child1);
+				Stack.push_back(Node.Child2);
+				continue;
+			}
+
+			// Each pair is found from both sides, keep the one from the lower id
+			if(Node.ID <= i)
+				continue;
+
+			const _BroadphaseProxy &ProxyB = Proxies[Node.ID];
+			if(Overlaps(ProxyA.AABB, ProxyB.AABB) && ShouldCollide(ProxyA, ProxyB))
+				Pairs.push_back({ (NetworkIDType)i, Node.ID });
+		}
+	}
+}
+
+// Get colliders overlapping an AABB
+void _AABBTree::Query(const glm::vec4 &AABB, std::vector<NetworkIDType> &Results) {
+	Results.clear();
+	if(Root == -1)
+		return;
+
+	Stack.clear();
+	Stack.push_back(Root);
+	while(!Stack.empty()) {
+		const _Node &Node = Nodes[Stack.back()];
+		Stack.pop_back();
+		if(!Overlaps(Node.AABB, AABB))
+			continue;
+
+		if(Node.IsLeaf()) {
+			if(Overlaps(Proxies[Node.ID].AABB, AABB))
+				Results.push_back(Node.ID);
+		}
+		else {
+			Stack.push_back(Node.Child1);
+			Stack.push_back(Node.Child2);
+		}
+	}
+}
+
+// Get a node from the free list
+int _AABBTree::AllocateNode() {
+	int Node;
+	if(FreeList != -1) {
+		Node = FreeList;
+		FreeList = Nodes[Node].Parent;
+	}
+	else {
+		Node = (int)Nodes.size();
+		Nodes.push_back(_Node());
+	}
+
+	Nodes[Node].Parent = -1;
+	Nodes[Node].Child1 = -1;
+	Nodes[Node].Child2 = -1;
+	Nodes[Node].Height = 0;
+	Nodes[Node].ID = 0;
+
+	return Node;
+}
+
+// Return a node to the free list, reusing the parent index as the link
+void _AABBTree::FreeNode(int Node) {
+	Nodes[Node].Parent = FreeList;
+	Nodes[Node].Height = -1;
+	FreeList = Node;
+}
+
+// Combine two AABBs
+glm::vec4 _AABBTree::Combine(const glm::vec4 &A, const glm::vec4 &B) {
+	return glm::vec4(std::min(A[0], B[0]), std::min(A[1], B[1]), std::max(A[2], B[2]), std::max(A[3], B[3]));
+}
+
+// Insert a leaf next to the sibling that grows the tree's surface area the least
+void _AABBTree::InsertLeaf(int Leaf) {
+	if(Root == -1) {
+		Root = Leaf;
+		Nodes[Root].Parent = -1;
+		return;
+	}
+
+	// Find best sibling
+	glm::vec4 LeafAABB = Nodes[Leaf].AABB;
+	int Index = Root;
+	while(!Nodes[Index].IsLeaf()) {
+		int Child1 = Nodes[Index].Child1;
+		int Child2 = Nodes[Index].Child2;
+
+		float Area = GetPerimeter(Nodes[Index].AABB);
+		float CombinedArea = GetPerimeter(Combine(Nodes[Index].AABB, LeafAABB));
+
+		// Cost of making a new parent here, and the extra cost pushed down to children
+		float Cost = 2.0f * CombinedArea;
+		float InheritanceCost = 2.0f * (CombinedArea - Area);
+
+		float Cost1 = GetPerimeter(Combine(LeafAABB, Nodes[Child1].AABB)) + InheritanceCost;
+		if(!Nodes[Child1].IsLeaf())
+			Cost1 -= GetPerimeter(Nodes[Child1].AABB);
+
+		float Cost2 = GetPerimeter(Combine(LeafAABB, Nodes[Child2].AABB)) + InheritanceCost;
+		if(!Nodes[Child2].IsLeaf())
+			Cost2 -= GetPerimeter(Nodes[Child2].AABB);
+
+		if(Cost < Cost1 && Cost < Cost2)
+			break;
+
+		Index = Cost1 < Cost2 ? Child1 : Child2;
+	}
+
+	// Create new parent
+	int Sibling = Index;
+	int OldParent = Nodes[Sibling].Parent;
+	int NewParent = AllocateNode();
+	Nodes[NewParent].Parent = OldParent;
+	Nodes[NewParent].AABB = Combine(LeafAABB, Nodes[Sibling].AABB);
+	Nodes[NewParent].Height = Nodes[Sibling].Height + 1;
+	Nodes[NewParent].Child1 = Sibling;
+	Nodes[NewParent].Child2 = Leaf;
+	Nodes[Sibling].Parent = NewParent;
+	Nodes[Leaf].Parent = NewParent;
+
+	if(OldParent != -1) {
+		if(Nodes[OldParent].Child1 == Sibling)
+			Nodes[OldParent].Child1 = NewParent;
+		else
+			Nodes[OldParent].Child2 = NewParent;
+	}
+	else
+		Root = NewParent;
+
+	// Fix heights and bounds going up
+	Index = Nodes[Leaf].Parent;
+	while(Index != -1) {
+		Index = Balance(Index);
+
+		int Child1 = Nodes[Index].Child1;
+		int Child2 = Nodes[Index].Child2;
+		Nodes[Index].Height = 1 + std::max(Nodes[Child1].Height, Nodes[Child2].Height);
+		Nodes[Index].AABB = Combine(Nodes[Child1].AABB, Nodes[Child2].AABB);
+
+		Index = Nodes[Index].Parent;
+	}
+}
+
+// Remove a leaf and its parent, moving the sibling up
+void _AABBTree::RemoveLeaf(int Leaf) {
+	if(Leaf == Root) {
+		Root = -1;
+		return;
+	}
+
+	int Parent = Nodes[Leaf].Parent;
+	int GrandParent = Nodes[Parent].Parent;
+	int Sibling = Nodes[Parent].Child1 == Leaf ? Nodes[Parent].Child2 : Nodes[Parent].Child1;
+
+	if(GrandParent == -1) {
+		Root = Sibling;
+		Nodes[Sibling].Parent = -1;
+		FreeNode(Parent);
+		return;
+	}
+
+	if(Nodes[GrandParent].Child1 == Parent)
+		Nodes[GrandParent].Child1 = Sibling;
+	else
+		Nodes[GrandParent].Child2 = Sibling;
+	Nodes[Sibling].Parent = GrandParent;
+	FreeNode(Parent);
+
+	// Fix heights and bounds going up
+	int Index = GrandParent;
+	while(Index != -1) {
+		Index = Balance(Index);
+
+		int Child1 = Nodes[Index].Child1;
+		int Child2 = Nodes[Index].Child2;
+		Nodes[Index].Height = 1 + std::max(Nodes[Child1].Height, Nodes[Child2].Height);
+		Nodes[Index].AABB = Combine(Nodes[Child1].AABB, Nodes[Child2].AABB);
+
+		Index = Nodes[Index].Parent;
+	}
+}
+
+// Rotate node A if its children's heights differ by more than one, returns the node now in A's place
+int _AABBTree::Balance(int A) {
+	_Node *NodeA = &Nodes[A];
+	if(NodeA->IsLeaf() || NodeA->Height < 2)
+		return A;
+
+	int B = NodeA->Child1;
+	int C = NodeA->Child2;
+	int Difference = Nodes[C].Height - Nodes[B].Height;
+
+	// Rotate the taller child up
+	if(Difference > 1 || Difference < -1) {
+		int Up = Difference > 1 ? C : B;
+		int Other = Difference > 1 ? B : C;
+		_Node *NodeUp = &Nodes[Up];
+		int F = NodeUp->Child1;
+		int G = NodeUp->Child2;
+
+		// Swap A and Up
+		NodeUp->Child1 = A;
+		NodeUp->Parent = NodeA->Parent;
+		NodeA->Parent = Up;
+
+		if(NodeUp->Parent != -1) {
+			if(Nodes[NodeUp->Parent].Child1 == A)
+				Nodes[NodeUp->Parent].Child1 = Up;
+			else
+				Nodes[NodeUp->Parent].Child2 = Up;
+		}
+		else
+			Root = Up;
+
+		// Keep the taller grandchild under Up and give the other to A
+		int Keep = Nodes[F].Height > Nodes[G].Height ? F : G;
+		int Give = Keep == F ? G : F;
+		NodeUp->Child2 = Keep;
+		NodeA->Child1 = Other;
+		NodeA->Child2 = Give;
+		Nodes[Give].Parent = A;
+
+		NodeA->AABB = Combine(Nodes[Other].AABB, Nodes[Give].AABB);
+		NodeUp->AABB = Combine(NodeA->AABB, Nodes[Keep].AABB);
+		NodeA->Height = 1 + std::max(Nodes[Other].Height, Nodes[Give].Height);
+		NodeUp->Height = 1 + std::max(NodeA->Height, Nodes[Keep].Height);
+
+		return Up;
+	}
+
+	return A;
+}
+
+}
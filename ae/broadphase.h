@@ -0,0 +1,200 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ae/type.h>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <vector>
+#include <cstdint>
+
+namespace ae {
+
+// Collider in a broadphase, AABB is min x, min y, max x, max y like _Shape::GetAABB
+struct _BroadphaseProxy {
+	_BroadphaseProxy() : AABB(0.0f), CollisionMask(0), CollisionGroup(0), Node(-1), Active(false) { }
+
+	glm::vec4 AABB;
+	int CollisionMask;
+	int CollisionGroup;
+	int Node;
+	bool Active;
+};
+
+// Colliders with overlapping AABBs, A is less than B
+struct _BroadphasePair {
+	NetworkIDType A;
+	NetworkIDType B;
+};
+
+// Finds pairs of colliders that might be touching
+class _Broadphase {
+
+	public:
+
+		_Broadphase() : Count(0) { }
+		virtual ~_Broadphase() { }
+
+		// Colliders are keyed by object id
+		virtual void Insert(NetworkIDType ID, const glm::vec4 &AABB, int CollisionMask, int CollisionGroup);
+		virtual void Move(NetworkIDType ID, const glm::vec4 &AABB);
+		virtual void Remove(NetworkIDType ID);
+		virtual void Clear();
+
+		// Replace Pairs with every overlapping pair that passes the collision filter
+		virtual void FindPairs(std::vector<_BroadphasePair> &Pairs) = 0;
+
+		// Get colliders overlapping an AABB
+		virtual void Query(const glm::vec4 &AABB, std::vector<NetworkIDType> &Results) = 0;
+
+		bool Contains(NetworkIDType ID) const { return ID < Proxies.size() && Proxies[ID].Active; }
+		const _BroadphaseProxy &GetProxy(NetworkIDType ID) const { return Proxies[ID]; }
+		std::size_t GetCount() const { return Count; }
+
+		static bool Overlaps(const glm::vec4 &A, const glm::vec4 &B) { return A[0] <= B[2] && B[0] <= A[2] && A[1] <= B[3] && B[1] <= A[3]; }
+
+		// A pair is kept if either collider's mask includes the other's group
+		static bool ShouldCollide(const _BroadphaseProxy &A, const _BroadphaseProxy &B) { return (A.CollisionMask & B.CollisionGroup) || (B.CollisionMask & A.CollisionGroup); }
+
+	protected:
+
+		std::vector<_BroadphaseProxy> Proxies;
+		std::size_t Count;
+
+};
+
+// Uniform grid with hashed cells. Best when colliders are about the cell size.
+// Only colliders that changed cells are rebinned, on the next FindPairs or Query. Colliders covering
+// more than MaxCells cells or with non-finite bounds are kept in a list and tested against everything.
+class _HashGrid : public _Broadphase {
+
+	public:
+
+		_HashGrid(float CellSize=1.0f, int MaxCells=64) : CellSize(CellSize), MaxCells(MaxCells) { }
+
+		void Insert(NetworkIDType ID, const glm::vec4 &AABB, int CollisionMask, int CollisionGroup) override;
+		void Move(NetworkIDType ID, const glm::vec4 &AABB) override;
+		void Remove(NetworkIDType ID) override;
+		void Clear() override;
+
+		void FindPairs(std::vector<_BroadphasePair> &Pairs) override;
+		void Query(const glm::vec4 &AABB, std::vector<NetworkIDType> &Results) override;
+
+	private:
+
+		// Collider in one cell
+		struct _CellEntry {
+			uint32_t Hash;
+			int32_t X;
+			int32_t Y;
+			NetworkIDType ID;
+		};
+
+		// Cells a collider is binned in
+		struct _CellRange {
+			_CellRange() : StartX(0), StartY(0), EndX(-1), EndY(-1), Large(false), Changed(false) { }
+			bool operator!=(const _CellRange &Range) const { return StartX != Range.StartX || StartY != Range.StartY || EndX != Range.EndX || EndY != Range.EndY || Large != Range.Large; }
+
+			int32_t StartX;
+			int32_t StartY;
+			int32_t EndX;
+			int32_t EndY;
+			bool Large;
+			bool Changed;
+		};
+
+		void MarkChanged(NetworkIDType ID);
+		void UpdateCells();
+		_CellRange GetRange(const glm::vec4 &AABB) const;
+		int32_t GetCell(float Value) const;
+		static uint32_t HashCell(int32_t X, int32_t Y) { return ((uint32_t)X * 73856093U) ^ ((uint32_t)Y * 19349663U); }
+
+		static bool CompareEntries(const _CellEntry &A, const _CellEntry &B) {
+			if(A.Hash != B.Hash)
+				return A.Hash < B.Hash;
+			if(A.X != B.X)
+				return A.X < B.X;
+			if(A.Y != B.Y)
+				return A.Y < B.Y;
+
+			return A.ID < B.ID;
+		}
+
+		float CellSize;
+		int MaxCells;
+		std::vector<_CellEntry> Entries;
+		std::vector<_CellEntry> NewEntries;
+		std::vector<_CellRange> Ranges;
+		std::vector<NetworkIDType> ChangedIDs;
+		std::vector<NetworkIDType> LargeIDs;
+
+};
+
+// Dynamic AABB tree with fattened leaves so small moves don't touch the tree
+class _AABBTree : public _Broadphase {
+
+	public:
+
+		_AABBTree(float Margin=0.1f);
+
+		void Insert(NetworkIDType ID, const glm::vec4 &AABB, int CollisionMask, int CollisionGroup) override;
+		void Move(NetworkIDType ID, const glm::vec4 &AABB) override;
+		void Remove(NetworkIDType ID) override;
+		void Clear() override;
+
+		void FindPairs(std::vector<_BroadphasePair> &Pairs) override;
+		void Query(const glm::vec4 &AABB, std::vector<NetworkIDType> &Results) override;
+
+		int GetHeight() const { return Root == -1 ? 0 : Nodes[Root].Height; }
+
+	private:
+
+		// Tree node, leaves have no children
+		struct _Node {
+			bool IsLeaf() const { return Child1 == -1; }
+
+			glm::vec4 AABB;
+			int Parent;
+			int Child1;
+			int Child2;
+			int Height;
+			NetworkIDType ID;
+		};
+
+		int AllocateNode();
+		void FreeNode(int Node);
+		void InsertLeaf(int Leaf);
+		void RemoveLeaf(int Leaf);
+		int Balance(int Node);
+
+		static glm::vec4 Combine(const glm::vec4 &A, const glm::vec4 &B);
+		static float GetPerimeter(const glm::vec4 &AABB) { return 2.0f * ((AABB[2] - AABB[0]) + (AABB[3] - AABB[1])); }
+		static bool ContainsAABB(const glm::vec4 &Outer, const glm::vec4 &Inner) { return Outer[0] <= Inner[0] && Outer[1] <= Inner[1] && Inner[2] <= Outer[2] && Inner[3] <= Outer[3]; }
+
+		std::vector<_Node> Nodes;
+		std::vector<int> Stack;
+		int Root;
+		int FreeList;
+		float Margin;
+
+};
+
+}
@@ -18,6 +18,8 @@
 * 3. This notice may not be removed or altered from any source distribution.
 *******************************************************************************/
 #include <ae/buffer.h>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 
 namespace ae {
@@ -26,45 +28,89 @@ namespace ae {
 _Buffer::_Buffer(std::size_t InitialSize) :
 	Data(nullptr),
 	CurrentByte(0),
-	CurrentBit(0) {
+	CurrentBit(0),
+	Error(false),
+	External(false),
+	Release(nullptr),
+	ReleaseHandle(nullptr) {
 
 	AllocatedSize = InitialSize;
-	Data = new char[AllocatedSize];
+	Capacity = InitialSize;
+	if(AllocatedSize)
+		Data = new char[AllocatedSize];
 }
 
 // Constructor for an existing buffer
 _Buffer::_Buffer(const char *ExistingBuffer, std::size_t Length) :
 	CurrentByte(0),
-	CurrentBit(0) {
+	CurrentBit(0),
+	Error(false),
+	External(false),
+	Release(nullptr),
+	ReleaseHandle(nullptr) {
 
 	AllocatedSize = Length;
+	Capacity = Length;
 	Data = new char[AllocatedSize];
 
 	memcpy(Data, ExistingBuffer, AllocatedSize);
 }
 
+// Constructor that reads from external memory without copying. Release is called with Handle when the buffer is done with it.
+_Buffer::_Buffer(char *ExternalBuffer, std::size_t Length, ReleaseFunction Release, void *Handle) :
+	Data(ExternalBuffer),
+	AllocatedSize(Length),
+	CurrentByte(0),
+	Capacity(Length),
+	CurrentBit(0),
+	Error(false),
+	External(true),
+	Release(Release),
+	ReleaseHandle(Handle) {
+
+}
+
 // Destructor
 _Buffer::~_Buffer() {
 
-	delete[] Data;
+	FreeData();
+}
+
+// Free owned memory or release adopted memory
+void _Buffer::FreeData() {
+	if(External) {
+		if(Release)
+			Release(ReleaseHandle);
+
+		External = false;
+		Release = nullptr;
+		ReleaseHandle = nullptr;
+	}
+	else
+		delete[] Data;
+
+	Data = nullptr;
 }
 
 // Resize the buffer
 void _Buffer::Resize(std::size_t NewSize) {
-	if(NewSize == AllocatedSize)
+	if(NewSize == Capacity) {
+		AllocatedSize = NewSize;
 		return;
+	}
 
 	// Make new buffer
 	char *NewData = new char[NewSize];
-	if(NewSize < AllocatedSize)
+	if(NewSize < Capacity)
 		memcpy(NewData, Data, NewSize);
-	else
-		memcpy(NewData, Data, AllocatedSize);
+	else if(Capacity)
+		memcpy(NewData, Data, Capacity);
 
-	// Delete old buffer and set size
-	delete[] Data;
+	// Free old buffer and set size
+	FreeData();
 	Data = NewData;
 	AllocatedSize = NewSize;
+	Capacity = NewSize;
 }
 
 // Shrinks the buffer to the current used size
@@ -76,6 +122,34 @@ void _Buffer::Shrink() {
 	Resize(NewSize);
 }
 
+// Empty the buffer for reuse, keeping owned memory but releasing adopted memory
+void _Buffer::Reset() {
+	if(External) {
+		FreeData();
+		Capacity = 0;
+	}
+
+	AllocatedSize = Capacity;
+	CurrentByte = 0;
+	CurrentBit = 0;
+	Error = false;
+}
+
+// Free current memory and read from external memory instead
+void _Buffer::Adopt(char *ExternalBuffer, std::size_t Length, ReleaseFunction Release, void *Handle) {
+	FreeData();
+
+	Data = ExternalBuffer;
+	AllocatedSize = Length;
+	Capacity = Length;
+	CurrentByte = 0;
+	CurrentBit = 0;
+	Error = false;
+	External = true;
+	this->Release = Release;
+	ReleaseHandle = Handle;
+}
+
 // Aligns the buffer to the next byte
 void _Buffer::AlignBitIndex() {
 
@@ -92,8 +166,22 @@ void _Buffer::AlignAndExpand(std::size_t NewWriteSize) {
 
 	// Resize the buffer if needed
 	std::size_t NewSize = CurrentByte + NewWriteSize;
-	if(NewSize > AllocatedSize)
+	if(NewSize > Capacity)
 		Resize(NewSize << 1);
+	else if(NewSize > AllocatedSize)
+		AllocatedSize = Capacity;
+}
+
+// Check that bytes are available to read, otherwise set the error flag and move to the end
+bool _Buffer::CanRead(std::size_t Size) {
+	if(!Error && Size <= AllocatedSize && CurrentByte <= AllocatedSize - Size)
+		return true;
+
+	Error = true;
+	CurrentByte = AllocatedSize;
+	CurrentBit = 0;
+
+	return false;
 }
 
 // Writes a bit to the buffer
@@ -130,8 +218,35 @@ void _Buffer::WriteString(const char *Value) {
 	CurrentByte++;
 }
 
+// Writes raw bytes
+void _Buffer::WriteData(const void *Source, std::size_t Size) {
+	AlignAndExpand(Size);
+
+	if(Size)
+		memcpy(&Data[CurrentByte], Source, Size);
+	CurrentByte += Size;
+}
+
+// Reads raw bytes, fills with zeros if past the end
+bool _Buffer::ReadData(void *Destination, std::size_t Size) {
+	AlignBitIndex();
+	if(!CanRead(Size)) {
+		memset(Destination, 0, Size);
+		return false;
+	}
+
+	if(Size)
+		memcpy(Destination, &Data[CurrentByte], Size);
+	CurrentByte += Size;
+
+	return true;
+}
+
 // Reads a bit from the buffer
 bool _Buffer::ReadBit() {
+	if(CurrentBit == 0 && !CanRead(1))
+		return false;
+
 	bool Bit = !!(Data[CurrentByte] & (1 << CurrentBit));
 
 	// Increment bit index
@@ -144,14 +259,154 @@ bool _Buffer::ReadBit() {
 	return Bit;
 }
 
-// Reads a string from the buffer
+// Reads a string from the buffer, returns an empty string if it isn't terminated
 const char *_Buffer::ReadString() {
 	AlignBitIndex();
+	if(!CanRead(1))
+		return "";
 
+	// Find end of string within the buffer
 	const char *String = (const char *)(&Data[CurrentByte]);
-	CurrentByte += strlen(String) + 1;
+	const char *End = (const char *)memchr(String, 0, AllocatedSize - CurrentByte);
+	if(!End) {
+		Error = true;
+		CurrentByte = AllocatedSize;
+		return "";
+	}
+
+	CurrentByte += (std::size_t)(End - String) + 1;
 
 	return String;
 }
 
+// Writes the low bits of a value
+void _Buffer::WriteBits(uint32_t Value, int Count) {
+	while(Count > 0) {
+
+		// If it's the first bit in the byte, clear the byte
+		if(CurrentBit == 0) {
+			AlignAndExpand(1);
+			Data[CurrentByte] = 0;
+		}
+
+		// Fill the rest of the current byte
+		int Bits = std::min(8 - (int)CurrentBit, Count);
+		Data[CurrentByte] |= (char)((Value & ((1U << Bits) - 1)) << CurrentBit);
+		Value >>= Bits;
+		Count -= Bits;
+
+		// Increment the bit index
+		CurrentBit += Bits;
+		if(CurrentBit == 8) {
+			CurrentBit = 0;
+			CurrentByte++;
+		}
+	}
+}
+
+// Reads a value written with WriteBits
+uint32_t _Buffer::ReadBits(int Count) {
+	uint32_t Value = 0;
+	int Shift = 0;
+	while(Count > 0) {
+
+		if(CurrentBit == 0 && !CanRead(1))
+			return Value;
+
+		// Read from the rest of the current byte
+		int Bits = std::min(8 - (int)CurrentBit, Count);
+		uint32_t Byte = (unsigned char)Data[CurrentByte] >> CurrentBit;
+		Value |= (Byte & ((1U << Bits) - 1)) << Shift;
+		Shift += Bits;
+		Count -= Bits;
+
+		// Increment the bit index
+		CurrentBit += Bits;
+		if(CurrentBit == 8) {
+			CurrentBit = 0;
+			CurrentByte++;
+		}
+	}
+
+	return Value;
+}
+
+// Writes an integer using 7 bits per group plus a continue bit
+void _Buffer::WriteVarInt(uint64_t Value) {
+	while(Value >= 0x80) {
+		WriteBits((uint32_t)(Value & 0x7F) | 0x80, 8);
+		Value >>= 7;
+	}
+
+	WriteBits((uint32_t)Value, 8);
+}
+
+// Reads an integer written with WriteVarInt
+uint64_t _Buffer::ReadVarInt() {
+	uint64_t Value = 0;
+	for(int Shift = 0; Shift < 64; Shift += 7) {
+		uint32_t Group = ReadBits(8);
+		Value |= (uint64_t)(Group & 0x7F) << Shift;
+		if(!(Group & 0x80))
+			break;
+	}
+
+	return Value;
+}
+
+// Keep bit counts in the range WriteBits supports
+static int ClampQuantizedBits(int Bits) {
+	return std::min(std::max(Bits, 1), 32);
+}
+
+// Writes a float clamped to a range using a fixed number of bits
+void _Buffer::WriteQuantizedFloat(float Value, float Min, float Max, int Bits) {
+	Bits = ClampQuantizedBits(Bits);
+	double Steps = (double)((1ULL << Bits) - 1);
+
+	// Empty ranges and NaN write zero
+	double Normalized = Max > Min ? ((double)Value - Min) / ((double)Max - Min) : 0.0;
+	if(!(Normalized >= 0.0))
+		Normalized = 0.0;
+	else if(Normalized > 1.0)
+		Normalized = 1.0;
+
+	WriteBits((uint32_t)std::min(Normalized * Steps + 0.5, Steps), Bits);
+}
+
+// Reads a float written with WriteQuantizedFloat
+float _Buffer::ReadQuantizedFloat(float Min, float Max, int Bits) {
+	Bits = ClampQuantizedBits(Bits);
+	double Steps = (double)((1ULL << Bits) - 1);
+	uint32_t Value = ReadBits(Bits);
+	if(!(Max > Min))
+		return Min;
+
+	return (float)(Min + Value * (((double)Max - Min) / Steps));
+}
+
+// Writes a position inside bounds
+void _Buffer::WriteQuantizedVec2(const glm::vec2 &Value, const glm::vec2 &Min, const glm::vec2 &Max, int Bits) {
+	WriteQuantizedFloat(Value.x, Min.x, Max.x, Bits);
+	WriteQuantizedFloat(Value.y, Min.y, Max.y, Bits);
+}
+
+// Reads a position written with WriteQuantizedVec2
+glm::vec2 _Buffer::ReadQuantizedVec2(const glm::vec2 &Min, const glm::vec2 &Max, int Bits) {
+	float X = ReadQuantizedFloat(Min.x, Max.x, Bits);
+	float Y = ReadQuantizedFloat(Min.y, Max.y, Bits);
+
+	return glm::vec2(X, Y);
+}
+
+// Get number of bits needed to store a range with a given precision
+int _Buffer::GetQuantizedBits(float Min, float Max, float Precision) {
+	double Steps = std::ceil((Max - Min) / Precision);
+	int Bits = 1;
+	while(Bits < 32 && (double)((1ULL << Bits) - 1) < Steps)
+		Bits++;
+
+	return Bits;
+}
+
 }
@@ -20,7 +20,10 @@
 #pragma once
 
 // Libraries
+#include <glm/vec2.hpp>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 
 namespace ae {
 
@@ -29,8 +32,12 @@ class _Buffer {
 
 	public:
 
+		// Function to free adopted memory
+		typedef void (*ReleaseFunction)(void *Handle);
+
 		_Buffer(std::size_t InitialSize=32);
 		_Buffer(const char *ExistingBuffer, std::size_t Length);
+		_Buffer(char *ExternalBuffer, std::size_t Length, ReleaseFunction Release, void *Handle);
 		~_Buffer();
 
 		// Write data
@@ -38,49 +45,93 @@ class _Buffer {
 			AlignAndExpand(sizeof(T));
 
 			T *Address = (T *)&Data[CurrentByte];
-			*Address = Value;
+			memcpy(Address, &Value, sizeof(T));
 
 			CurrentByte += sizeof(T);
 			return Address;
 		}
 
-		// Read data
+		// Read data, sets the error flag and returns zero if past the end
 		template<typename T> T Read() {
 			AlignBitIndex();
 
-			T Value = *(T *)(&Data[CurrentByte]);
+			T Value = T();
+			if(!CanRead(sizeof(T)))
+				return Value;
+
+			memcpy(&Value, &Data[CurrentByte], sizeof(T));
 			CurrentByte += sizeof(T);
 
 			return Value;
 		}
 
+		// Raw bytes
+		void WriteData(const void *Source, std::size_t Size);
+		bool ReadData(void *Destination, std::size_t Size);
+
 		void WriteBit(bool Value);
 		void WriteString(const char *Value);
 
 		bool ReadBit();
 		const char *ReadString();
 
+		// Bit packed values, these don't align to the next byte
+		void WriteBits(uint32_t Value, int Count);
+		void WriteVarInt(uint64_t Value);
+		void WriteSignedVarInt(int64_t Value) { WriteVarInt(((uint64_t)Value << 1) ^ (uint64_t)(Value >> 63)); }
+		void WriteQuantizedFloat(float Value, float Min, float Max, int Bits);
+		void WriteQuantizedVec2(const glm::vec2 &Value, const glm::vec2 &Min, const glm::vec2 &Max, int Bits);
+
+		uint32_t ReadBits(int Count);
+		uint64_t ReadVarInt();
+		int64_t ReadSignedVarInt() { uint64_t Value = ReadVarInt(); return (int64_t)(Value >> 1) ^ -(int64_t)(Value & 1); }
+		float ReadQuantizedFloat(float Min, float Max, int Bits);
+		glm::vec2 ReadQuantizedVec2(const glm::vec2 &Min, const glm::vec2 &Max, int Bits);
+
+		// Get number of bits needed to store a range with a given precision
+		static int GetQuantizedBits(float Min, float Max, float Precision);
+
 		const char *GetData() const { return Data; }
 		char &operator[](std::size_t Index) { return Data[Index]; }
 		char operator[](std::size_t Index) const { return Data[Index]; }
 
 		void Shrink();
+		void Reset();
+		void Adopt(char *ExternalBuffer, std::size_t Length, ReleaseFunction Release, void *Handle);
+		bool IsExternal() const { return External; }
+		// Allocated size is the readable size, setting it doesn't change the capacity and Reset restores it
 		void SetAllocatedSize(std::size_t Size) { AllocatedSize = Size; }
 		std::size_t GetAllocatedSize() const { return AllocatedSize; }
+		std::size_t GetCapacity() const { return Capacity; }
 		std::size_t GetCurrentSize() const { return CurrentByte + (CurrentBit != 0); }
 		bool End() const { return CurrentByte == AllocatedSize; }
 
-		void StartRead() { CurrentByte = 0; CurrentBit = 0; }
+		// Bytes left to read after aligning to the next byte
+		std::size_t GetRemainingSize() const { return AllocatedSize > GetCurrentSize() ? AllocatedSize - GetCurrentSize() : 0; }
+
+		void StartRead() { CurrentByte = 0; CurrentBit = 0; Error = false; }
+
+		// Check once after parsing if any read went past the end
+		bool HasError() const { return Error; }
 
 	private:
 
 		void Resize(std::size_t NewSize);
+		void FreeData();
 		void AlignBitIndex();
 		void AlignAndExpand(std::size_t NewWriteSize);
+		bool CanRead(std::size_t Size);
 
 		char *Data;
 		std::size_t AllocatedSize, CurrentByte;
+		std::size_t Capacity;
 		unsigned char CurrentBit;
+		bool Error;
+
+		// Adopted memory
+		bool External;
+		ReleaseFunction Release;
+		void *ReleaseHandle;
 };
 
 }
@@ -0,0 +1,154 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#include <ae/buffer_pool.h>
+
+namespace ae {
+
+_BufferPool BufferPool;
+
+// Constructor
+_BufferPool::_BufferPool() {
+
+}
+
+// Destructor
+_BufferPool::~_BufferPool() {
+
+	for(int i = 0; i < SIZE_CLASSES; i++) {
+		for(auto &Buffer : FreeBuffers[i])
+			delete Buffer;
+	}
+
+	for(auto &Buffer : FreeWrappers)
+		delete Buffer;
+}
+
+// Get smallest size class that fits, or -1 if too large
+int _BufferPool::GetSizeClass(std::size_t Size) {
+	for(int i = 0; i < SIZE_CLASSES; i++) {
+		if(Size <= GetClassSize(i))
+			return i;
+	}
+
+	return -1;
+}
+
+// Get a buffer with room for at least Size bytes
+_Buffer *_BufferPool::Acquire(std::size_t Size) {
+	int SizeClass = GetSizeClass(Size);
+	if(SizeClass == -1) {
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Stats.Acquired++;
+		Stats.Allocated++;
+		return new _Buffer(Size);
+	}
+
+	// Take from the smallest free list that fits
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Stats.Acquired++;
+		for(int i = SizeClass; i < SIZE_CLASSES; i++) {
+			std::vector<_Buffer *> &FreeList = FreeBuffers[i];
+			if(!FreeList.empty()) {
+				_Buffer *Buffer = FreeList.back();
+				FreeList.pop_back();
+				return Buffer;
+			}
+		}
+
+		Stats.Allocated++;
+	}
+
+	return new _Buffer(GetClassSize(SizeClass));
+}
+
+// Get a buffer that reads from external memory
+_Buffer *_BufferPool::AcquireExternal(char *ExternalBuffer, std::size_t Length, _Buffer::ReleaseFunction Release, void *Handle) {
+	_Buffer *Buffer = nullptr;
+
+	// Take an empty buffer from free list
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Stats.Acquired++;
+		if(!FreeWrappers.empty()) {
+			Buffer = FreeWrappers.back();
+			FreeWrappers.pop_back();
+		}
+		else
+			Stats.Allocated++;
+	}
+
+	if(!Buffer)
+		return new _Buffer(ExternalBuffer, Length, Release, Handle);
+
+	Buffer->Adopt(ExternalBuffer, Length, Release, Handle);
+
+	return Buffer;
+}
+
+// Return a buffer to the pool
+void _BufferPool::Release(_Buffer *Buffer) {
+	if(!Buffer)
+		return;
+
+	// Release adopted memory outside the lock
+	bool External = Buffer->IsExternal();
+	Buffer->Reset();
+
+	// Find free list, owned buffers go in the largest class they can serve
+	std::vector<_Buffer *> *FreeList = &FreeWrappers;
+	if(!External) {
+		FreeList = nullptr;
+		for(int i = SIZE_CLASSES - 1; i >= 0; i--) {
+			if(Buffer->GetCapacity() >= GetClassSize(i)) {
+				FreeList = &FreeBuffers[i];
+				break;
+			}
+		}
+	}
+
+	// Add to free list
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Stats.Released++;
+		if(FreeList && FreeList->size() < MAX_FREE) {
+			FreeList->push_back(Buffer);
+			return;
+		}
+
+		Stats.Discarded++;
+	}
+
+	delete Buffer;
+}
+
+// Get stats
+_BufferPoolStats _BufferPool::GetStats() {
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	_BufferPoolStats CurrentStats = Stats;
+	CurrentStats.Free = FreeWrappers.size();
+	for(int i = 0; i < SIZE_CLASSES; i++)
+		CurrentStats.Free += FreeBuffers[i].size();
+
+	return CurrentStats;
+}
+
+}
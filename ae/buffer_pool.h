@@ -0,0 +1,77 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ae/buffer.h>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+namespace ae {
+
+// Pool usage
+struct _BufferPoolStats {
+	_BufferPoolStats() : Acquired(0), Released(0), Allocated(0), Discarded(0), Free(0) { }
+
+	std::size_t Acquired;
+	std::size_t Released;
+	std::size_t Allocated;
+	std::size_t Discarded;
+	std::size_t Free;
+};
+
+// Thread safe pool of reusable buffers grouped by capacity
+class _BufferPool {
+
+	public:
+
+		static const int SIZE_CLASSES = 6;
+		static const std::size_t MAX_FREE = 1024;
+
+		_BufferPool();
+		~_BufferPool();
+
+		// Get a buffer with room for at least Size bytes
+		_Buffer *Acquire(std::size_t Size=0);
+
+		// Get a buffer that reads from external memory, see _Buffer::Adopt
+		_Buffer *AcquireExternal(char *ExternalBuffer, std::size_t Length, _Buffer::ReleaseFunction Release, void *Handle);
+
+		// Return a buffer to the pool
+		void Release(_Buffer *Buffer);
+
+		_BufferPoolStats GetStats();
+
+	private:
+
+		static int GetSizeClass(std::size_t Size);
+		static std::size_t GetClassSize(int SizeClass) { return (std::size_t)64 << (SizeClass * 2); }
+
+		std::mutex Mutex;
+		std::vector<_Buffer *> FreeBuffers[SIZE_CLASSES];
+		std::vector<_Buffer *> FreeWrappers;
+		_BufferPoolStats Stats;
+
+};
+
+extern _BufferPool BufferPool;
+
+}
@@ -30,7 +30,7 @@ template<class T> class _CircularBuffer {
 		_CircularBuffer() : Data(nullptr) { }
 
 		// Constructor with size
-		_CircularBuffer(int Size) {
+		_CircularBuffer(int Size) : Data(nullptr) {
 			Init(Size);
 		}
 
@@ -51,6 +51,21 @@ template<class T> class _CircularBuffer {
 			WriteIndex = 0;
 		}
 
+		// Change capacity while keeping contents, newest entries are kept if shrinking
+		void Resize(int Size) {
+			int Count = CurrentSize < Size ? CurrentSize : Size;
+			T *NewData = new T[Size];
+			for(int i = 0; i < Count; i++)
+				NewData[i] = Front(CurrentSize - Count + i);
+
+			delete[] Data;
+			Data = NewData;
+			CurrentSize = Count;
+			MaxSize = Size;
+			ReadIndex = 0;
+			WriteIndex = Count < Size ? Count : 0;
+		}
+
 		// Free memory
 		void Close() {
 			delete[] Data;
@@ -69,13 +84,28 @@ template<class T> class _CircularBuffer {
 			return CurrentSize == 0;
 		}
 
+		// Check if buffer is full
+		bool IsFull() const {
+			return CurrentSize == MaxSize;
+		}
+
 		// Get size
 		int Size() const {
 			return CurrentSize;
 		}
 
+		// Get max size
+		int Capacity() const {
+			return MaxSize;
+		}
+
 		// Add to back of queue
 		void PushBack(const T &Value) {
+			PushBack() = Value;
+		}
+
+		// Add to back of queue and return the slot to fill in place
+		T &PushBack() {
 
 			// Update size
 			CurrentSize++;
@@ -86,13 +116,29 @@ template<class T> class _CircularBuffer {
 					ReadIndex = 0;
 			}
 
-			// Save data
-			Data[WriteIndex] = Value;
+			// Get slot
+			T &Slot = Data[WriteIndex];
 
 			// Update pointers
 			WriteIndex++;
 			if(WriteIndex >= MaxSize)
 				WriteIndex = 0;
+
+			return Slot;
+		}
+
+		// Move the back element forward until Less(Previous, Back) holds, keeping the queue sorted
+		template<typename F> void SortBack(F Less) {
+			for(int i = 0; i < CurrentSize - 1; i++) {
+				T &Previous = Back(i + 1);
+				T &Current = Back(i);
+				if(!Less(Current, Previous))
+					break;
+
+				T Temp = Previous;
+				Previous = Current;
+				Current = Temp;
+			}
 		}
 
 		// Pop back of queue
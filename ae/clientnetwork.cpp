@@ -63,6 +63,7 @@ void _ClientNetwork::Connect(const std::string &HostAddress, uint16_t Port) {
 		throw std::runtime_error("enet_host_connect returned nullptr");
 
 	Peer->ENetPeer = ENetPeer;
+	Peer->ConnectID = ENetPeer->connectID;
 	ConnectionState = State::CONNECTING;
 }
 
@@ -94,7 +95,7 @@ void _ClientNetwork::CreateEvent(_NetworkEvent &Event, double EventTime, ENetEve
 }
 
 // Handle the event internally
-void _ClientNetwork::HandleEvent(_NetworkEvent &Event, ENetEvent &EEvent) {
+void _ClientNetwork::HandleEvent(_NetworkEvent &Event, ENetEvent &) {
 
 	// Add peer
 	switch(Event.Type) {
@@ -104,10 +105,8 @@ void _ClientNetwork::HandleEvent(_NetworkEvent &Event, ENetEvent &EEvent) {
 		case _NetworkEvent::DISCONNECT:
 			ConnectionState = State::DISCONNECTED;
 		break;
-		case _NetworkEvent::PACKET: {
-			Event.Data = new _Buffer((char *)EEvent.packet->data, EEvent.packet->dataLength);
-			enet_packet_destroy(EEvent.packet);
-		} break;
+		case _NetworkEvent::PACKET:
+		break;
 	}
 }
 
@@ -115,11 +114,10 @@ void _ClientNetwork::HandleEvent(_NetworkEvent &Event, ENetEvent &EEvent) {
 void _ClientNetwork::SendPacket(_Buffer &Buffer, SendType Type, uint8_t Channel) {
 
 	// Create enet packet
-	ENetPacket *EPacket = enet_packet_create(Buffer.GetData(), Buffer.GetCurrentSize(), Type);
+	ENetPacket *EPacket = CreateENetPacket(Buffer, Type);
 
 	// Send packet
-	if(enet_peer_send(Peer->ENetPeer, Channel, EPacket) != 0)
-		enet_packet_destroy(EPacket);
+	SendENetPacket(Peer->ENetPeer, Peer->ConnectID, Channel, EPacket);
 }
 
 // Get round trip time
@@ -0,0 +1,311 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#include <ae/compression.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace ae {
+
+const int COMPRESSION_HASH_BITS = 12;
+const std::size_t COMPRESSION_MIN_MATCH = 4;
+const std::size_t COMPRESSION_MAX_OFFSET = 65535;
+
+// Read 4 bytes
+static inline uint32_t Read32(const uint8_t *Data) {
+	uint32_t Value;
+	memcpy(&Value, Data, sizeof(Value));
+	return Value;
+}
+
+// Hash 4 bytes into a table index
+static inline uint32_t Hash32(uint32_t Value) {
+	return (Value * 2654435761U) >> (32 - COMPRESSION_HASH_BITS);
+}
+
+// Write a length continuation, returns false if out of room
+static bool WriteLength(uint8_t *Destination, std::size_t Capacity, std::size_t &Out, std::size_t Length) {
+	while(Length >= 255) {
+		if(Out >= Capacity)
+			return false;
+
+		Destination[Out++] = 255;
+		Length -= 255;
+	}
+
+	if(Out >= Capacity)
+		return false;
+
+	Destination[Out++] = (uint8_t)Length;
+	return true;
+}
+
+// Read a length continuation, returns false if it runs past the end
+static bool ReadLength(const uint8_t *Source, std::size_t Size, std::size_t &In, std::size_t &Length) {
+	uint8_t Byte;
+	do {
+		if(In >= Size)
+			return false;
+
+		Byte = Source[In++];
+		Length += Byte;
+	} while(Byte == 255);
+
+	return true;
+}
+
+// Write one sequence of literals followed by an optional match
+static bool WriteSequence(uint8_t *Destination, std::size_t Capacity, std::size_t &Out, const uint8_t *Literals, std::size_t LiteralLength, std::size_t Offset, std::size_t MatchLength) {
+	std::size_t MatchCode = MatchLength ? MatchLength - COMPRESSION_MIN_MATCH : 0;
+	if(Out >= Capacity)
+		return false;
+
+	// Token
+	Destination[Out++] = (uint8_t)((std::min<std::size_t>(LiteralLength, 15) << 4) | std::min<std::size_t>(MatchCode, 15));
+	if(LiteralLength >= 15 && !WriteLength(Destination, Capacity, Out, LiteralLength - 15))
+		return false;
+
+	// Literals
+	if(Out + LiteralLength > Capacity)
+		return false;
+
+	if(LiteralLength)
+		memcpy(Destination + Out, Literals, LiteralLength);
+	Out += LiteralLength;
+	if(!MatchLength)
+		return true;
+
+	// Match
+	if(Out + 2 > Capacity)
+		return false;
+
+	Destination[Out++] = (uint8_t)(Offset & 0xFF);
+	Destination[Out++] = (uint8_t)(Offset >> 8);
+	if(MatchCode >= 15 && !WriteLength(Destination, Capacity, Out, MatchCode - 15))
+		return false;
+
+	return true;
+}
+
+// Constructor
+_Compressor::_Compressor() :
+	DictionaryTable(1 << COMPRESSION_HASH_BITS, -1),
+	Table(1 << COMPRESSION_HASH_BITS),
+	TableGenerations(1 << COMPRESSION_HASH_BITS, 0),
+	Generation(0) {
+
+}
+
+// Set dictionary, only the last 64KB is used
+void _Compressor::SetDictionary(const void *Data, std::size_t Size) {
+	const uint8_t *Bytes = (const uint8_t *)Data;
+	if(Size > COMPRESSION_MAX_OFFSET) {
+		Bytes += Size - COMPRESSION_MAX_OFFSET;
+		Size = COMPRESSION_MAX_OFFSET;
+	}
+
+	Dictionary.assign(Bytes, Bytes + Size);
+
+	// Hash dictionary positions once so each packet can start from them
+	std::fill(DictionaryTable.begin(), DictionaryTable.end(), -1);
+	for(std::size_t i = 0; i + COMPRESSION_MIN_MATCH <= Size; i++)
+		DictionaryTable[Hash32(Read32(&Dictionary[i]))] = (int32_t)i;
+}
+
+// Compress data
+std::size_t _Compressor::Compress(const void *Source, std::size_t Size, void *Destination, std::size_t Capacity) {
+	uint8_t *Output = (uint8_t *)Destination;
+
+	// Start a new generation so entries from the last packet are ignored
+	if(++Generation == 0) {
+		std::fill(TableGenerations.begin(), TableGenerations.end(), 0);
+		Generation = 1;
+	}
+
+	// Table positions count from the start of the dictionary, packet bytes begin at Start
+	const uint8_t *Input = (const uint8_t *)Source;
+	const uint8_t *DictionaryData = Dictionary.data();
+	std::size_t Start = Dictionary.size();
+
+	std::size_t Out = 0;
+	std::size_t Anchor = 0;
+	std::size_t Position = 0;
+	while(Position + COMPRESSION_MIN_MATCH <= Size) {
+		uint32_t Value = Read32(Input + Position);
+		uint32_t HashIndex = Hash32(Value);
+		int32_t Candidate = TableGenerations[HashIndex] == Generation ? Table[HashIndex] : DictionaryTable[HashIndex];
+		std::size_t WindowPosition = Start + Position;
+		Table[HashIndex] = (int32_t)WindowPosition;
+		TableGenerations[HashIndex] = Generation;
+
+		if(Candidate < 0 || WindowPosition - Candidate > COMPRESSION_MAX_OFFSET) {
+			Position++;
+			continue;
+		}
+
+		// Candidate is in the dictionary or earlier in the packet
+		bool InDictionary = (std::size_t)Candidate < Start;
+		const uint8_t *Match = InDictionary ? DictionaryData + Candidate : Input + (Candidate - Start);
+		if(Read32(Match) != Value) {
+			Position++;
+			continue;
+		}
+
+		// Extend match, dictionary matches can run on into the packet
+		std::size_t Length = COMPRESSION_MIN_MATCH;
+		std::size_t MatchEnd = InDictionary ? Start - Candidate : Size;
+		while(Position + Length < Size && Length < MatchEnd && Match[Length] == Input[Position + Length])
+			Length++;
+		if(InDictionary && Length == MatchEnd) {
+			while(Position + Length < Size && Input[Candidate + Length - Start] == Input[Position + Length])
+				Length++;
+		}
+
+		if(!WriteSequence(Output, Capacity, Out, Input + Anchor, Position - Anchor, WindowPosition - Candidate, Length))
+			return 0;
+
+		Position += Length;
+		Anchor = Position;
+	}
+
+	// Remaining literals end the block
+	if(!WriteSequence(Output, Capacity, Out, Input + Anchor, Size - Anchor, 0, 0) || Out >= Size)
+		return 0;
+
+	Stats.Packets++;
+	Stats.InputBytes += Size;
+	Stats.OutputBytes += Out;
+
+	return Out;
+}
+
+// Decompress data
+bool _Compressor::Decompress(const void *Source, std::size_t Size, void *Destination, std::size_t DestinationSize) const {
+	const uint8_t *Input = (const uint8_t *)Source;
+	uint8_t *Output = (uint8_t *)Destination;
+
+	std::size_t In = 0;
+	std::size_t Out = 0;
+	while(In < Size) {
+		uint8_t Token = Input[In++];
+
+		// Literals
+		std::size_t LiteralLength = Token >> 4;
+		if(LiteralLength == 15 && !ReadLength(Input, Size, In, LiteralLength))
+			return false;
+		if(In + LiteralLength > Size || Out + LiteralLength > DestinationSize)
+			return false;
+
+		if(LiteralLength)
+			memcpy(Output + Out, Input + In, LiteralLength);
+		In += LiteralLength;
+		Out += LiteralLength;
+
+		// Last sequence has no match
+		if(In == Size)
+			break;
+
+		// Match
+		if(In + 2 > Size)
+			return false;
+
+		std::size_t Offset = Input[In] | (Input[In + 1] << 8);
+		In += 2;
+
+		std::size_t MatchLength = Token & 15;
+		if(MatchLength == 15 && !ReadLength(Input, Size, In, MatchLength))
+			return false;
+
+		MatchLength += COMPRESSION_MIN_MATCH;
+		if(!Offset || Offset > Out + Dictionary.size() || Out + MatchLength > DestinationSize)
+			return false;
+
+		// Copy from the dictionary first
+		if(Offset > Out) {
+			std::size_t DictionaryIndex = Dictionary.size() - (Offset - Out);
+			std::size_t Count = std::min(MatchLength, Offset - Out);
+			memcpy(Output + Out, &Dictionary[DictionaryIndex], Count);
+			Out += Count;
+			MatchLength -= Count;
+		}
+
+		// Matches can overlap the bytes they write
+		if(Offset >= MatchLength)
+			memcpy(Output + Out, Output + Out - Offset, MatchLength);
+		else {
+			for(std::size_t i = 0; i < MatchLength; i++)
+				Output[Out + i] = Output[Out + i - Offset];
+		}
+		Out += MatchLength;
+	}
+
+	return Out == DestinationSize;
+}
+
+// Write stats as a json object
+void _CompressionStats::WriteJSON(std::ostream &Stream) const {
+	Stream << "{\n";
+	Stream << "\t\"packets\": " << Packets << ",\n";
+	Stream << "\t\"input_bytes\": " << InputBytes << ",\n";
+	Stream << "\t\"output_bytes\": " << OutputBytes << ",\n";
+	Stream << "\t\"savings\": " << GetSavings() << ",\n";
+	Stream << "\t\"compress_mb_per_second\": " << (CompressTime > 0.0 ? InputBytes / CompressTime / 1e6 : 0.0) << ",\n";
+	Stream << "\t\"decompress_mb_per_second\": " << (DecompressTime > 0.0 ? InputBytes / DecompressTime / 1e6 : 0.0) << ",\n";
+	Stream << "\t\"compress_ns_per_byte\": " << (InputBytes ? CompressTime * 1e9 / InputBytes : 0.0) << ",\n";
+	Stream << "\t\"decompress_ns_per_byte\": " << (InputBytes ? DecompressTime * 1e9 / InputBytes : 0.0) << "\n";
+	Stream << "}\n";
+}
+
+// Measure bytes saved and time spent on a set of sample packets. Samples that don't compress count as stored.
+_CompressionStats BenchmarkCompression(_Compressor &Compressor, const std::vector<std::vector<uint8_t>> &Samples, int Iterations) {
+	_CompressionStats Results;
+	std::vector<uint8_t> Compressed;
+	std::vector<uint8_t> Decompressed;
+	for(int Iteration = 0; Iteration < Iterations; Iteration++) {
+		for(const auto &Sample : Samples) {
+			Compressed.resize(_Compressor::GetMaxCompressedSize(Sample.size()));
+			Decompressed.resize(Sample.size());
+
+			// Compress
+			auto Start = std::chrono::steady_clock::now();
+			std::size_t Size = Compressor.Compress(Sample.data(), Sample.size(), Compressed.data(), Compressed.size());
+			auto Middle = std::chrono::steady_clock::now();
+
+			// Decompress
+			if(Size && !Compressor.Decompress(Compressed.data(), Size, Decompressed.data(), Decompressed.size()))
+				throw std::runtime_error("BenchmarkCompression: decompressed data doesn't match");
+			auto End = std::chrono::steady_clock::now();
+
+			if(Size && memcmp(Decompressed.data(), Sample.data(), Sample.size()))
+				throw std::runtime_error("BenchmarkCompression: decompressed data doesn't match");
+
+			Results.Packets++;
+			Results.InputBytes += Sample.size();
+			Results.OutputBytes += Size ? Size : Sample.size();
+			Results.CompressTime += std::chrono::duration<double>(Middle - Start).count();
+			Results.DecompressTime += std::chrono::duration<double>(End - Middle).count();
+		}
+	}
+
+	return Results;
+}
+
+}
@@ -0,0 +1,83 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ostream>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace ae {
+
+// Compression totals
+struct _CompressionStats {
+	_CompressionStats() : Packets(0), InputBytes(0), OutputBytes(0), CompressTime(0.0), DecompressTime(0.0) { }
+
+	// Fraction of bytes saved
+	double GetSavings() const { return InputBytes ? 1.0 - (double)OutputBytes / InputBytes : 0.0; }
+	void WriteJSON(std::ostream &Stream) const;
+
+	uint64_t Packets;
+	uint64_t InputBytes;
+	uint64_t OutputBytes;
+
+	// Seconds spent, only filled by BenchmarkCompression
+	double CompressTime;
+	double DecompressTime;
+};
+
+// LZ77 byte compressor with an optional shared dictionary. Uses an LZ4 style block format with 64KB window.
+class _Compressor {
+
+	public:
+
+		_Compressor();
+
+		// Sample data that packets are likely to repeat, both ends must use the same dictionary
+		void SetDictionary(const void *Data, std::size_t Size);
+
+		// Returns compressed size, or 0 if the data didn't get smaller or doesn't fit in Capacity
+		std::size_t Compress(const void *Source, std::size_t Size, void *Destination, std::size_t Capacity);
+
+		// Decompress exactly DestinationSize bytes, returns false on bad data
+		bool Decompress(const void *Source, std::size_t Size, void *Destination, std::size_t DestinationSize) const;
+
+		static std::size_t GetMaxCompressedSize(std::size_t Size) { return Size + Size / 255 + 16; }
+
+		const _CompressionStats &GetStats() const { return Stats; }
+
+	private:
+
+		std::vector<uint8_t> Dictionary;
+		std::vector<int32_t> DictionaryTable;
+
+		// Positions hashed from the current packet, entries from older calls have a stale generation
+		std::vector<int32_t> Table;
+		std::vector<uint32_t> TableGenerations;
+		uint32_t Generation;
+		_CompressionStats Stats;
+
+};
+
+// Time compressing and decompressing each sample Iterations times
+_CompressionStats BenchmarkCompression(_Compressor &Compressor, const std::vector<std::vector<uint8_t>> &Samples, int Iterations=100);
+
+}
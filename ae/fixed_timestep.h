@@ -0,0 +1,174 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ae/framelimit.h>
+#include <chrono>
+#include <cstdint>
+
+namespace ae {
+
+// Timing for a fixed timestep loop, times are in seconds
+struct _FixedTimestepStats {
+	_FixedTimestepStats() :
+		Frames(0),
+		Steps(0),
+		ClampedFrames(0),
+		DroppedSteps(0),
+		LastSteps(0),
+		FrameTime(0.0),
+		MaxFrameTime(0.0),
+		StepTime(0.0),
+		MaxStepTime(0.0) { }
+
+	// Average step time as a fraction of the timestep, above 1 means the simulation can't keep up
+	double GetLoad(double TimeStep) const { return TimeStep > 0.0 ? StepTime / TimeStep : 0.0; }
+
+	uint64_t Frames;
+	uint64_t Steps;
+
+	// Frames longer than the max frame time
+	uint64_t ClampedFrames;
+
+	// Steps skipped after hitting the max steps per frame
+	uint64_t DroppedSteps;
+
+	int LastSteps;
+
+	// Smoothed frame time and longest frame
+	double FrameTime;
+	double MaxFrameTime;
+
+	// Smoothed time spent in one step and longest step
+	double StepTime;
+	double MaxStepTime;
+};
+
+// Runs a simulation at a fixed rate and reports how far the renderer is between steps.
+//
+//	int Steps = Timestep.Update([&](double TimeStep) { State->Update(TimeStep); });
+//	State->Render(Timestep.GetBlendFactor());
+//	Timestep.Limit();
+class _FixedTimestep {
+
+	public:
+
+		_FixedTimestep(double TimeStep, int MaxSteps=5, double MaxFrameTime=0.25, double FrameRate=0.0) :
+			FrameLimit(FrameRate),
+			TimeStep(TimeStep),
+			MaxFrameTime(MaxFrameTime),
+			Accumulator(0.0),
+			MaxSteps(MaxSteps) { Reset(); }
+
+		// Restart timing, call after loading or a long pause
+		void Reset() {
+			Timer = std::chrono::steady_clock::now();
+			Accumulator = 0.0;
+			FrameLimit.Reset();
+		}
+
+		// Run Step for the real time since the last call, returns steps taken
+		template<typename F> int Update(const F &Step) {
+			std::chrono::steady_clock::time_point Time = std::chrono::steady_clock::now();
+			double FrameTime = std::chrono::duration<double>(Time - Timer).count();
+			Timer = Time;
+
+			return Advance(FrameTime, Step);
+		}
+
+		// Run Step for a given frame time, returns steps taken
+		template<typename F> int Advance(double FrameTime, const F &Step) {
+			if(FrameTime < 0.0)
+				FrameTime = 0.0;
+
+			// Don't try to catch up after a stall
+			if(MaxFrameTime > 0.0 && FrameTime > MaxFrameTime) {
+				FrameTime = MaxFrameTime;
+				Stats.ClampedFrames++;
+			}
+
+			UpdateAverage(Stats.FrameTime, FrameTime, Stats.Frames);
+			if(FrameTime > Stats.MaxFrameTime)
+				Stats.MaxFrameTime = FrameTime;
+
+			// Run whole steps
+			Accumulator += FrameTime;
+			int Steps = 0;
+			while(Accumulator >= TimeStep && (MaxSteps <= 0 || Steps < MaxSteps)) {
+				std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+				Step(TimeStep);
+				double Time = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+				UpdateAverage(Stats.StepTime, Time, Stats.Steps);
+				if(Time > Stats.MaxStepTime)
+					Stats.MaxStepTime = Time;
+
+				Accumulator -= TimeStep;
+				Stats.Steps++;
+				Steps++;
+			}
+
+			// Drop steps that didn't fit so the backlog can't grow
+			if(Accumulator >= TimeStep) {
+				uint64_t Dropped = (uint64_t)(Accumulator / TimeStep);
+				Accumulator -= Dropped * TimeStep;
+				Stats.DroppedSteps += Dropped;
+			}
+
+			Stats.Frames++;
+			Stats.LastSteps = Steps;
+
+			return Steps;
+		}
+
+		// Sleep for the rest of the frame if a frame rate is set
+		void Limit() { FrameLimit.Update(); }
+
+		// Fraction of a step between the last state and the next, for Render(BlendFactor)
+		double GetBlendFactor() const { return TimeStep > 0.0 ? Accumulator / TimeStep : 0.0; }
+
+		// Settings
+		void SetTimeStep(double Value) { TimeStep = Value; Accumulator = 0.0; }
+		void SetMaxSteps(int Value) { MaxSteps = Value; }
+		void SetMaxFrameTime(double Value) { MaxFrameTime = Value; }
+		void SetFrameRate(double Value) { FrameLimit.SetFrameRate(Value); }
+		double GetTimeStep() const { return TimeStep; }
+		const _FixedTimestepStats &GetStats() const { return Stats; }
+		void ResetStats() { Stats = _FixedTimestepStats(); }
+
+	private:
+
+		// Moving average that starts from the first sample
+		static void UpdateAverage(double &Average, double Value, uint64_t Count) {
+			Average = Count ? Average + (Value - Average) * 0.05 : Value;
+		}
+
+		_FrameLimit FrameLimit;
+		_FixedTimestepStats Stats;
+		std::chrono::steady_clock::time_point Timer;
+		double TimeStep;
+		double MaxFrameTime;
+		double Accumulator;
+		int MaxSteps;
+
+};
+
+}
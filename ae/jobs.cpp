@@ -0,0 +1,152 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#include <ae/jobs.h>
+
+namespace ae {
+
+// Constructor, a negative thread count uses one worker per extra core
+_JobSystem::_JobSystem(int ThreadCount) :
+	Done(false),
+	QueuedJobs(0),
+	PendingJobs(0) {
+
+	if(ThreadCount < 0)
+		ThreadCount = (int)std::thread::hardware_concurrency() - 1;
+
+	// Queue 0 belongs to the calling thread
+	for(int i = 0; i < ThreadCount + 1; i++)
+		Queues.push_back(new _Queue());
+
+	// Start workers
+	for(int i = 0; i < ThreadCount; i++)
+		Threads.push_back(std::thread(RunThread, this, (std::size_t)i + 1));
+}
+
+// Destructor
+_JobSystem::~_JobSystem() {
+
+	// Wake and join workers
+	{
+		std::lock_guard<std::mutex> Lock(WakeMutex);
+		Done = true;
+	}
+	WakeCondition.notify_all();
+
+	for(auto &Thread : Threads)
+		Thread.join();
+
+	for(auto &Queue : Queues)
+		delete Queue;
+}
+
+// Split range into jobs and help run them until all are finished
+void _JobSystem::ParallelFor(std::size_t Count, std::size_t ChunkSize, void (*Function)(void *, std::size_t, std::size_t), void *Data) {
+	if(!Count)
+		return;
+
+	if(!ChunkSize)
+		ChunkSize = 1;
+
+	// Run inline when there are no workers or only one chunk
+	if(Threads.empty() || Count <= ChunkSize) {
+		Function(Data, 0, Count);
+		return;
+	}
+
+	// Distribute chunks across queues
+	std::size_t JobCount = (Count + ChunkSize - 1) / ChunkSize;
+	PendingJobs += JobCount;
+	for(std::size_t i = 0; i < JobCount; i++) {
+		std::size_t Start = i * ChunkSize;
+		std::size_t End = Start + ChunkSize < Count ? Start + ChunkSize : Count;
+
+		_Queue *Queue = Queues[i % Queues.size()];
+		std::lock_guard<std::mutex> Lock(Queue->Mutex);
+		Queue->Jobs.push_back(_Job(Function, Data, Start, End));
+	}
+
+	// Wake workers
+	{
+		std::lock_guard<std::mutex> Lock(WakeMutex);
+		QueuedJobs += JobCount;
+	}
+	WakeCondition.notify_all();
+
+	// Work on jobs from this thread too
+	_Job Job;
+	while(GetJob(0, Job))
+		RunJob(Job);
+
+	// Wait for stolen jobs to finish
+	while(PendingJobs)
+		std::this_thread::yield();
+}
+
+// Worker thread loop
+void _JobSystem::RunThread(_JobSystem *JobSystem, std::size_t Index) {
+	_Job Job;
+	while(true) {
+		if(JobSystem->GetJob(Index, Job)) {
+			JobSystem->RunJob(Job);
+			continue;
+		}
+
+		// Sleep until more jobs are queued
+		std::unique_lock<std::mutex> Lock(JobSystem->WakeMutex);
+		JobSystem->WakeCondition.wait(Lock, [JobSystem] { return JobSystem->Done || JobSystem->QueuedJobs; });
+		if(JobSystem->Done)
+			return;
+	}
+}
+
+// Take a job from the back of our queue, or steal from the front of another
+bool _JobSystem::GetJob(std::size_t Index, _Job &Job) {
+	if(!QueuedJobs)
+		return false;
+
+	for(std::size_t i = 0; i < Queues.size(); i++) {
+		_Queue *Queue = Queues[(Index + i) % Queues.size()];
+		std::lock_guard<std::mutex> Lock(Queue->Mutex);
+		if(Queue->Jobs.empty())
+			continue;
+
+		if(i == 0) {
+			Job = Queue->Jobs.back();
+			Queue->Jobs.pop_back();
+		}
+		else {
+			Job = Queue->Jobs.front();
+			Queue->Jobs.pop_front();
+		}
+
+		QueuedJobs--;
+		return true;
+	}
+
+	return false;
+}
+
+// Run a job and mark it finished
+void _JobSystem::RunJob(const _Job &Job) {
+	Job.Function(Job.Data, Job.Start, Job.End);
+	PendingJobs--;
+}
+
+}
@@ -0,0 +1,91 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+namespace ae {
+
+// Range of work for a job
+struct _Job {
+	_Job() : Function(nullptr), Data(nullptr), Start(0), End(0) { }
+	_Job(void (*Function)(void *, std::size_t, std::size_t), void *Data, std::size_t Start, std::size_t End) : Function(Function), Data(Data), Start(Start), End(End) { }
+
+	void (*Function)(void *Data, std::size_t Start, std::size_t End);
+	void *Data;
+	std::size_t Start;
+	std::size_t End;
+};
+
+// Work-stealing thread pool
+class _JobSystem {
+
+	public:
+
+		_JobSystem(int ThreadCount=-1);
+		~_JobSystem();
+
+		// Run Function(Data, Start, End) over chunks of [0, Count) and wait for completion
+		void ParallelFor(std::size_t Count, std::size_t ChunkSize, void (*Function)(void *, std::size_t, std::size_t), void *Data);
+
+		// Run Function(Start, End) over chunks of [0, Count) and wait for completion
+		template<typename F> void ParallelFor(std::size_t Count, std::size_t ChunkSize, const F &Function) {
+			ParallelFor(Count, ChunkSize, RunFunctor<F>, (void *)&Function);
+		}
+
+		int GetThreadCount() const { return (int)Threads.size(); }
+
+	private:
+
+		// Job list for each thread
+		struct _Queue {
+			std::mutex Mutex;
+			std::deque<_Job> Jobs;
+		};
+
+		template<typename F> static void RunFunctor(void *Data, std::size_t Start, std::size_t End) {
+			(*(const F *)Data)(Start, End);
+		}
+
+		static void RunThread(_JobSystem *JobSystem, std::size_t Index);
+		bool GetJob(std::size_t Index, _Job &Job);
+		void RunJob(const _Job &Job);
+
+		// Threads
+		std::vector<std::thread> Threads;
+		std::vector<_Queue *> Queues;
+		std::mutex WakeMutex;
+		std::condition_variable WakeCondition;
+		std::atomic<bool> Done;
+
+		// Counts
+		std::atomic<std::size_t> QueuedJobs;
+		std::atomic<std::size_t> PendingJobs;
+
+};
+
+}
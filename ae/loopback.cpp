@@ -0,0 +1,234 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#include <ae/loopback.h>
+#include <ae/buffer.h>
+#include <ae/buffer_pool.h>
+#include <ae/servernetwork.h>
+#include <algorithm>
+
+namespace ae {
+
+// Constructor
+_LoopbackHub::_LoopbackHub() :
+	Server(nullptr),
+	ServerMessages(256),
+	PacketCount(0),
+	ByteCount(0) {
+
+}
+
+// Destructor
+_LoopbackHub::~_LoopbackHub() {
+
+	// Server peers stop pointing at connections and connected clients get a disconnect
+	if(Server)
+		Server->DetachLoopback();
+
+	// Free undelivered packets
+	while(!ServerMessages.IsEmpty()) {
+		BufferPool.Release(ServerMessages.Front().Data);
+		ServerMessages.Pop();
+	}
+
+	// Detach clients
+	for(auto &Connection : Connections) {
+		if(Connection->Client)
+			Connection->Client->ReceiveMessage(_LoopbackMessage());
+
+		delete Connection;
+	}
+}
+
+// Create a connection for a client
+_LoopbackConnection *_LoopbackHub::CreateConnection(_LoopbackClient *Client) {
+	_LoopbackConnection *Connection = new _LoopbackConnection(this, Client);
+	Connections.push_back(Connection);
+
+	return Connection;
+}
+
+// Delete a connection once the client, the server peer and queued messages are gone
+void _LoopbackHub::FreeConnection(_LoopbackConnection *Connection) {
+	if(Connection->Client || Connection->ServerPeer || Connection->PendingMessages)
+		return;
+
+	Connections.erase(std::find(Connections.begin(), Connections.end(), Connection));
+	delete Connection;
+}
+
+// Add message to a queue, growing it if needed
+void _LoopbackHub::PushMessage(_CircularBuffer<_LoopbackMessage> &Queue, const _LoopbackMessage &Message) {
+	if(Queue.IsFull())
+		Queue.Resize(Queue.Capacity() * 2);
+
+	Queue.PushBack(Message);
+}
+
+// Create message with a copy of the packet data
+_LoopbackMessage _LoopbackHub::CreateMessage(_LoopbackConnection *Connection, _NetworkEvent::EventType Type, const _Buffer *Buffer, int EventData, bool Reliable) {
+	_LoopbackMessage Message;
+	Message.Type = Type;
+	Message.Connection = Connection;
+	Message.EventData = EventData;
+	Message.Reliable = Reliable;
+	if(Buffer) {
+		std::size_t Size = Buffer->GetCurrentSize();
+		Message.Data = BufferPool.Acquire(Size);
+		Message.Data->WriteData(Buffer->GetData(), Size);
+		Message.Data->SetAllocatedSize(Size);
+		Message.Data->StartRead();
+
+		PacketCount++;
+		ByteCount += Size;
+	}
+
+	return Message;
+}
+
+// Queue message for the server
+void _LoopbackHub::SendToServer(_LoopbackConnection *Connection, _NetworkEvent::EventType Type, const _Buffer *Buffer, int EventData, bool Reliable) {
+	Connection->PendingMessages++;
+	PushMessage(ServerMessages, CreateMessage(Connection, Type, Buffer, EventData, Reliable));
+}
+
+// Queue message for a client
+void _LoopbackHub::SendToClient(_LoopbackConnection *Connection, _NetworkEvent::EventType Type, const _Buffer *Buffer, int EventData, bool Reliable) {
+	if(!Connection->Client)
+		return;
+
+	Connection->Client->ReceiveMessage(CreateMessage(Connection, Type, Buffer, EventData, Reliable));
+}
+
+// Get next message for the server
+bool _LoopbackHub::GetServerMessage(_LoopbackMessage &Message) {
+	if(ServerMessages.IsEmpty())
+		return false;
+
+	Message = ServerMessages.Front();
+	Message.Connection->PendingMessages--;
+	ServerMessages.Pop();
+
+	return true;
+}
+
+// Constructor
+_LoopbackClient::_LoopbackClient(_LoopbackHub *Hub) :
+	_Network(false),
+	LoopbackConnection(nullptr),
+	Messages(64),
+	SentData(0),
+	ReceivedData(0) {
+
+	LoopbackConnection = Hub->CreateConnection(this);
+}
+
+// Destructor
+_LoopbackClient::~_LoopbackClient() {
+	if(LoopbackConnection) {
+		Disconnect();
+		LoopbackConnection->Client = nullptr;
+		LoopbackConnection->Hub->FreeConnection(LoopbackConnection);
+	}
+
+	// Free undelivered packets
+	while(!Messages.IsEmpty()) {
+		BufferPool.Release(Messages.Front().Data);
+		Messages.Pop();
+	}
+}
+
+// Connect to the hub's server, a CONNECT event arrives after the server accepts
+void _LoopbackClient::Connect() {
+	if(!LoopbackConnection || LoopbackConnection->Connected)
+		return;
+
+	LoopbackConnection->Hub->SendToServer(LoopbackConnection, _NetworkEvent::CONNECT);
+}
+
+// Disconnect from the server, this works before the CONNECT event arrives once the server has accepted
+void _LoopbackClient::Disconnect(int Data) {
+	if(!LoopbackConnection || !LoopbackConnection->Accepted)
+		return;
+
+	LoopbackConnection->Connected = false;
+	LoopbackConnection->Accepted = false;
+	LoopbackConnection->Hub->SendToServer(LoopbackConnection, _NetworkEvent::DISCONNECT, nullptr, Data);
+
+	_LoopbackMessage Message;
+	Message.Type = _NetworkEvent::DISCONNECT;
+	Message.EventData = Data;
+	_LoopbackHub::PushMessage(Messages, Message);
+}
+
+// Send a packet to the server
+void _LoopbackClient::SendPacket(const _Buffer &Buffer, SendType Type, uint8_t) {
+	if(!LoopbackConnection || !LoopbackConnection->Connected)
+		return;
+
+	SentData += (uint32_t)Buffer.GetCurrentSize();
+	LoopbackConnection->Hub->SendToServer(LoopbackConnection, _NetworkEvent::PACKET, &Buffer, 0, Type == RELIABLE);
+}
+
+// Receive a message from the hub, a null connection means the hub was destroyed
+void _LoopbackClient::ReceiveMessage(const _LoopbackMessage &Message) {
+	if(!Message.Connection) {
+		LoopbackConnection = nullptr;
+		return;
+	}
+
+	_LoopbackHub::PushMessage(Messages, Message);
+}
+
+// Turn queued messages into network events
+void _LoopbackClient::ReceiveLoopbackEvents() {
+	while(!Messages.IsEmpty()) {
+		const _LoopbackMessage &Message = Messages.Front();
+
+		// Update connection state
+		if(LoopbackConnection) {
+			if(Message.Type == _NetworkEvent::CONNECT)
+				LoopbackConnection->Connected = true;
+			else if(Message.Type == _NetworkEvent::DISCONNECT)
+				LoopbackConnection->Connected = false;
+		}
+
+		_NetworkEvent Event;
+		Event.Type = Message.Type;
+		Event.Time = Time + FakeLag;
+		Event.EventData = Message.EventData;
+		Event.Data = Message.Data;
+		if(Event.Data)
+			ReceivedData += (uint32_t)Event.Data->GetAllocatedSize();
+
+		bool Reliable = Message.Reliable;
+		Messages.Pop();
+		QueueEvent(Event, Reliable);
+	}
+}
+
+// Get and reset data counters
+void _LoopbackClient::TakeDataTotals(uint32_t &SentData, uint32_t &ReceivedData) {
+	SentData = this->SentData;
+	ReceivedData = this->ReceivedData;
+	this->SentData = 0;
+	this->ReceivedData = 0;
+}
+
+}
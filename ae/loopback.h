@@ -0,0 +1,135 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ae/network.h>
+#include <ae/circular_buffer.h>
+#include <vector>
+#include <cstdint>
+
+namespace ae {
+
+// Forward Declarations
+class _Buffer;
+class _Peer;
+class _LoopbackClient;
+class _LoopbackHub;
+class _ServerNetwork;
+
+// In-memory connection between a loopback client and a server
+struct _LoopbackConnection {
+	_LoopbackConnection(_LoopbackHub *Hub, _LoopbackClient *Client) : Hub(Hub), Client(Client), ServerPeer(nullptr), PendingMessages(0), Accepted(false), Connected(false) { }
+
+	_LoopbackHub *Hub;
+	_LoopbackClient *Client;
+
+	// Server side, messages still queued for the server keep the connection alive
+	_Peer *ServerPeer;
+	uint32_t PendingMessages;
+	bool Accepted;
+
+	// Client side
+	bool Connected;
+};
+
+// Event passed between client and server
+struct _LoopbackMessage {
+	_LoopbackMessage() : Type(_NetworkEvent::PACKET), Connection(nullptr), Data(nullptr), EventData(0), Reliable(true) { }
+
+	_NetworkEvent::EventType Type;
+	_LoopbackConnection *Connection;
+	_Buffer *Data;
+	int EventData;
+	bool Reliable;
+};
+
+// Delivers messages between one _ServerNetwork and many _LoopbackClients without sockets
+class _LoopbackHub {
+
+	public:
+
+		_LoopbackHub();
+		~_LoopbackHub();
+
+		// Connections
+		_LoopbackConnection *CreateConnection(_LoopbackClient *Client);
+		void FreeConnection(_LoopbackConnection *Connection);
+
+		// Set by _ServerNetwork::AttachLoopback
+		void SetServer(_ServerNetwork *Server) { this->Server = Server; }
+
+		// Messages, packet data is copied
+		void SendToServer(_LoopbackConnection *Connection, _NetworkEvent::EventType Type, const _Buffer *Buffer=nullptr, int EventData=0, bool Reliable=true);
+		void SendToClient(_LoopbackConnection *Connection, _NetworkEvent::EventType Type, const _Buffer *Buffer=nullptr, int EventData=0, bool Reliable=true);
+		bool GetServerMessage(_LoopbackMessage &Message);
+
+		// Stats
+		uint64_t GetPacketCount() const { return PacketCount; }
+		uint64_t GetByteCount() const { return ByteCount; }
+
+		static void PushMessage(_CircularBuffer<_LoopbackMessage> &Queue, const _LoopbackMessage &Message);
+
+	private:
+
+		_LoopbackMessage CreateMessage(_LoopbackConnection *Connection, _NetworkEvent::EventType Type, const _Buffer *Buffer, int EventData, bool Reliable);
+
+		_ServerNetwork *Server;
+		std::vector<_LoopbackConnection *> Connections;
+		_CircularBuffer<_LoopbackMessage> ServerMessages;
+		uint64_t PacketCount;
+		uint64_t ByteCount;
+
+};
+
+// Client that talks to a _ServerNetwork through a _LoopbackHub
+class _LoopbackClient : public _Network {
+
+	public:
+
+		_LoopbackClient(_LoopbackHub *Hub);
+		~_LoopbackClient() override;
+
+		// Connections
+		void Connect();
+		void Disconnect(int Data=0);
+		bool IsConnected() const { return LoopbackConnection && LoopbackConnection->Connected; }
+
+		// Packets
+		void SendPacket(const _Buffer &Buffer, SendType Type=RELIABLE, uint8_t Channel=0);
+
+		// Called by hub
+		void ReceiveMessage(const _LoopbackMessage &Message);
+
+	protected:
+
+		void ReceiveLoopbackEvents() override;
+		void TakeDataTotals(uint32_t &SentData, uint32_t &ReceivedData) override;
+
+	private:
+
+		_LoopbackConnection *LoopbackConnection;
+		_CircularBuffer<_LoopbackMessage> Messages;
+		uint32_t SentData;
+		uint32_t ReceivedData;
+
+};
+
+}
@@ -21,46 +21,119 @@
 
 // Libraries
 #include <ae/type.h>
-#include <unordered_map>
-#include <list>
+#include <ae/circular_buffer.h>
+#include <ae/pool.h>
+#include <ae/jobs.h>
+#include <vector>
 #include <limits>
 #include <stdexcept>
+#include <cstdint>
 
 namespace ae {
 
+// Handle to a managed object that detects reuse of its id
+struct _ObjectHandle {
+	_ObjectHandle() : ID(0), Generation(0) { }
+	_ObjectHandle(NetworkIDType ID, uint16_t Generation) : ID(ID), Generation(Generation) { }
+
+	NetworkIDType ID;
+	uint16_t Generation;
+};
+
+// Maps an object id to its index in the object array
+struct _ManagerSlot {
+	static const uint32_t NONE = 0xFFFFFFFFU;
+
+	_ManagerSlot() : Index(NONE), Generation(1), Queued(false) { }
+	bool IsUsed() const { return Index != NONE; }
+
+	uint32_t Index;
+	uint16_t Generation;
+	bool Queued;
+};
+
+// Object churn counters
+struct _ManagerStats {
+	_ManagerStats() : Created(0), Deleted(0) { }
+
+	std::size_t Created;
+	std::size_t Deleted;
+};
+
 // Classes
 template<class T> class _Manager {
 
 	public:
 
+		static const uint32_t ID_COUNT = (uint32_t)std::numeric_limits<NetworkIDType>::max() + 1;
+
 		_Manager();
 		~_Manager();
 
 		// Updates
 		void Update(double FrameTime);
+		void Reclaim();
+
+		// Threading
+		void SetJobSystem(_JobSystem *JobSystem, std::size_t ChunkSize=64) { this->JobSystem = JobSystem; this->ChunkSize = ChunkSize; }
+		void SetDeterministic(bool Value) { Deterministic = Value; }
 
 		// Object management
 		T *Create();
 		T *CreateWithID(NetworkIDType ID);
 		T *GetObject(NetworkIDType ID);
+		T *GetObject(const _ObjectHandle &Handle);
+		_ObjectHandle GetHandle(const T *Object) const;
 		void Clear();
 
+		// Stats
+		const _ManagerStats &GetFrameStats() const { return FrameStats; }
+		const _ManagerStats &GetTotalStats() const { return TotalStats; }
+		const _PoolStats &GetPoolStats() const { return Pool.GetStats(); }
+
+		// Memory
+		void SetPoolGrowth(std::size_t ChunkObjects, std::size_t MaxChunkObjects) { Pool.SetGrowth(ChunkObjects, MaxChunkObjects); }
+		void ReservePool(std::size_t Count) { Pool.Reserve(Count); }
+
 		// Storage
-		std::list<T *> Objects;
-		std::list<T *> DeleteList;
+		std::vector<T *> Objects;
+		std::vector<T *> DeleteList;
 
 	private:
 
+		void UpdateParallel(double FrameTime);
+		T *AddObject(NetworkIDType ID);
+		void DeleteObject(T *Object);
+		void ReleaseID(NetworkIDType ID);
+
 		// IDs
-		std::unordered_map<NetworkIDType, T *> IDMap;
-		NetworkIDType NextID;
+		std::vector<_ManagerSlot> Slots;
+		_CircularBuffer<NetworkIDType> FreeIDs;
+		uint32_t NextID;
+
+		// Memory
+		_Pool<T> Pool;
+
+		// Threading
+		_JobSystem *JobSystem;
+		std::size_t ChunkSize;
+		bool Deterministic;
+
+		// Stats
+		_ManagerStats CurrentStats;
+		_ManagerStats FrameStats;
+		_ManagerStats TotalStats;
 
 };
 
 // Constructor
 template <class T>
 _Manager<T>::_Manager() :
-	NextID(0) {
+	FreeIDs((int)ID_COUNT),
+	NextID(0),
+	JobSystem(nullptr),
+	ChunkSize(64),
+	Deterministic(false) {
 
 }
 
@@ -69,56 +142,112 @@ template <class T>
 _Manager<T>::~_Manager() {
 
 	for(auto &Object : Objects)
-		delete Object;
+		DeleteObject(Object);
 }
 
 // Update
 template <class T>
 void _Manager<T>::Update(double FrameTime) {
+	if(JobSystem && !Deterministic) {
+		UpdateParallel(FrameTime);
+		return;
+	}
 
-	// Update objects
-	for(auto Iterator = Objects.begin(); Iterator != Objects.end(); ) {
-		T *Object = *Iterator;
+	// Update objects, including ones created during the loop
+	for(std::size_t i = 0; i < Objects.size(); i++) {
+		T *Object = Objects[i];
 
 		// Update the object
 		Object->Update(FrameTime);
 
 		// Move deleted objects to deleted list
-		if(Object->Deleted) {
+		if(Object->Deleted)
 			DeleteList.push_back(Object);
-			Iterator = Objects.erase(Iterator);
-		}
-		else {
-			++Iterator;
+	}
+
+	Reclaim();
+}
+
+// Update thread safe objects on the job system, then the rest in order
+template <class T>
+void _Manager<T>::UpdateParallel(double FrameTime) {
+
+	// Update parallel objects
+	std::size_t Count = Objects.size();
+	JobSystem->ParallelFor(Count, ChunkSize, [this, FrameTime](std::size_t Start, std::size_t End) {
+		for(std::size_t i = Start; i < End; i++) {
+			T *Object = Objects[i];
+			if(Object->ParallelUpdate)
+				Object->Update(FrameTime);
 		}
+	});
+
+	// Update remaining objects, including ones created during the loop
+	for(std::size_t i = 0; i < Objects.size(); i++) {
+		T *Object = Objects[i];
+		if(i >= Count || !Object->ParallelUpdate)
+			Object->Update(FrameTime);
+
+		// Move deleted objects to deleted list
+		if(Object->Deleted)
+			DeleteList.push_back(Object);
+	}
+
+	Reclaim();
+}
+
+// Remove objects in the delete list and roll over frame stats
+template <class T>
+void _Manager<T>::Reclaim() {
+
+	// Swap remove deleted objects from the object array
+	for(auto &Object : DeleteList) {
+		uint32_t Index = Slots[Object->NetworkID].Index;
+		T *LastObject = Objects.back();
+		Objects[Index] = LastObject;
+		Slots[LastObject->NetworkID].Index = Index;
+		Objects.pop_back();
 	}
 
-	// Delete objects
+	// Free ids and memory
 	for(auto &Object : DeleteList) {
-		IDMap[Object->NetworkID] = nullptr;
-		delete Object;
+		ReleaseID(Object->NetworkID);
+		DeleteObject(Object);
 	}
 
+	CurrentStats.Deleted += DeleteList.size();
 	DeleteList.clear();
+
+	// Update stats
+	TotalStats.Created += CurrentStats.Created;
+	TotalStats.Deleted += CurrentStats.Deleted;
+	FrameStats = CurrentStats;
+	CurrentStats = _ManagerStats();
 }
 
 // Generate object with new network id
 template <class T>
 T *_Manager<T>::Create() {
 
-	// Search for an empty slot
-	for(NetworkIDType i = 0; i < std::numeric_limits<NetworkIDType>::max(); i++) {
-		if(!IDMap[NextID]) {
-			T *Object = new T;
-			Object->NetworkID = NextID;
+	// Hand out unused ids first so released ids aren't reused right away
+	while(NextID < ID_COUNT) {
+		NetworkIDType ID = (NetworkIDType)NextID++;
+		if(ID >= Slots.size())
+			Slots.resize(ID + 1);
 
-			Objects.push_back(Object);
-			IDMap[NextID] = Object;
+		if(!Slots[ID].IsUsed())
+			return AddObject(ID);
+	}
 
-			return Object;
-		}
+	// Reuse the oldest released id
+	while(!FreeIDs.IsEmpty()) {
+		NetworkIDType ID = FreeIDs.Front();
+		FreeIDs.Pop();
 
-		NextID++;
+		// Skip ids that were claimed by CreateWithID after release
+		Slots[ID].Queued = false;
+		if(!Slots[ID].IsUsed())
+			return AddObject(ID);
 	}
 
 	throw std::runtime_error("Ran out of object ids");
@@ -127,36 +256,95 @@ T *_Manager<T>::Create() {
 // Create object with existing id
 template <class T>
 T *_Manager<T>::CreateWithID(NetworkIDType ID) {
-	T *Object = new T;
-	Object->NetworkID = ID;
+	if(ID >= Slots.size())
+		Slots.resize(ID + 1);
 
-	Objects.push_back(Object);
-	IDMap[ID] = Object;
+	if(Slots[ID].IsUsed())
+		throw std::runtime_error("Object id already in use");
 
-	return Object;
+	return AddObject(ID);
 }
 
 // Get object from manager
 template <class T>
 T *_Manager<T>::GetObject(NetworkIDType ID) {
+	if(ID >= Slots.size() || !Slots[ID].IsUsed())
+		return nullptr;
 
-	auto Iterator = IDMap.find(ID);
-	if(Iterator == IDMap.end())
+	return Objects[Slots[ID].Index];
+}
+
+// Get object from handle, returns null if the id has been reused
+template <class T>
+T *_Manager<T>::GetObject(const _ObjectHandle &Handle) {
+	if(Handle.ID >= Slots.size() || Slots[Handle.ID].Generation != Handle.Generation)
 		return nullptr;
 
-	return Iterator->second;
+	return GetObject(Handle.ID);
+}
+
+// Get handle for an object
+template <class T>
+_ObjectHandle _Manager<T>::GetHandle(const T *Object) const {
+	if(!Object || Object->NetworkID >= Slots.size())
+		return _ObjectHandle();
+
+	return _ObjectHandle(Object->NetworkID, Slots[Object->NetworkID].Generation);
 }
 
 // Delete all objects and reset
 template <class T>
 void _Manager<T>::Clear() {
 
-	for(auto Object : Objects)
-		delete Object;
+	for(auto Object : Objects) {
+		ReleaseID(Object->NetworkID);
+		DeleteObject(Object);
+	}
 
-	IDMap.clear();
 	Objects.clear();
+	DeleteList.clear();
+	FreeIDs.Clear();
+	for(auto &Slot : Slots)
+		Slot.Queued = false;
+
 	NextID = 0;
 }
 
+// Allocate object and link it to a free slot
+template <class T>
+T *_Manager<T>::AddObject(NetworkIDType ID) {
+	T *Object = new (Pool.Allocate()) T;
+	Object->NetworkID = ID;
+
+	Slots[ID].Index = (uint32_t)Objects.size();
+	Objects.push_back(Object);
+	CurrentStats.Created++;
+
+	return Object;
+}
+
+// Destroy object and return memory to the pool
+template <class T>
+void _Manager<T>::DeleteObject(T *Object) {
+	Object->~T();
+	Pool.Free(Object);
+}
+
+// Unlink slot and queue id for reuse
+template <class T>
+void _Manager<T>::ReleaseID(NetworkIDType ID) {
+	_ManagerSlot &Slot = Slots[ID];
+	Slot.Index = _ManagerSlot::NONE;
+
+	// Invalidate handles, generation 0 is never valid
+	Slot.Generation++;
+	if(!Slot.Generation)
+		Slot.Generation = 1;
+
+	if(!Slot.Queued) {
+		FreeIDs.PushBack(ID);
+		Slot.Queued = true;
+	}
+}
+
 }
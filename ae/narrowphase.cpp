@@ -0,0 +1,508 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#include <ae/narrowphase.h>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define NARROWPHASE_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+#if NARROWPHASE_SSE2 && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define NARROWPHASE_AVX2 1
+	#include <immintrin.h>
+#endif
+
+namespace ae {
+
+// Kinds of shape pairs
+enum class PairType {
+	AABB_AABB,
+	CIRCLE_CIRCLE,
+	AABB_CIRCLE,
+};
+
+// Clear pairs
+void _ShapePairs::Clear() {
+	AX.clear();
+	AY.clear();
+	AHalfX.clear();
+	AHalfY.clear();
+	BX.clear();
+	BY.clear();
+	BHalfX.clear();
+	BHalfY.clear();
+	ObjectA.clear();
+	ObjectB.clear();
+	Swapped.clear();
+}
+
+// Add a pair of shapes to the list for their kind
+void _CollisionBatch::Add(const glm::vec2 &PositionA, const _Shape &ShapeA, void *ObjectA, const glm::vec2 &PositionB, const _Shape &ShapeB, void *ObjectB) {
+	bool Swapped = !ShapeA.IsAABB() && ShapeB.IsAABB();
+	const glm::vec2 &FirstPosition = Swapped ? PositionB : PositionA;
+	const glm::vec2 &SecondPosition = Swapped ? PositionA : PositionB;
+	const _Shape &First = Swapped ? ShapeB : ShapeA;
+	const _Shape &Second = Swapped ? ShapeA : ShapeB;
+
+	_ShapePairs *Pairs = &Mixed;
+	if(First.IsAABB() && Second.IsAABB())
+		Pairs = &AABBs;
+	else if(!First.IsAABB() && !Second.IsAABB())
+		Pairs = &Circles;
+
+	Pairs->AX.push_back(FirstPosition.x);
+	Pairs->AY.push_back(FirstPosition.y);
+	Pairs->AHalfX.push_back(First.HalfSize.x);
+	Pairs->AHalfY.push_back(First.HalfSize.y);
+	Pairs->BX.push_back(SecondPosition.x);
+	Pairs->BY.push_back(SecondPosition.y);
+	Pairs->BHalfX.push_back(Second.HalfSize.x);
+	Pairs->BHalfY.push_back(Second.HalfSize.y);
+	Pairs->ObjectA.push_back(Swapped ? ObjectB : ObjectA);
+	Pairs->ObjectB.push_back(Swapped ? ObjectA : ObjectB);
+	Pairs->Swapped.push_back(Swapped);
+}
+
+// Clear all pairs
+void _CollisionBatch::Clear() {
+	AABBs.Clear();
+	Circles.Clear();
+	Mixed.Clear();
+}
+
+// Add manifold for a pair, flipping it back if the shapes were swapped
+static inline void AddManifold(const _ShapePairs &Pairs, std::size_t Index, float NormalX, float NormalY, float Penetration, std::vector<_Manifold> &Manifolds) {
+	_Manifold Manifold;
+	Manifold.Penetration = Penetration;
+	if(Pairs.Swapped[Index]) {
+		Manifold.ObjectA = Pairs.ObjectB[Index];
+		Manifold.ObjectB = Pairs.ObjectA[Index];
+		Manifold.Normal = glm::vec2(-NormalX, -NormalY);
+	}
+	else {
+		Manifold.ObjectA = Pairs.ObjectA[Index];
+		Manifold.ObjectB = Pairs.ObjectB[Index];
+		Manifold.Normal = glm::vec2(NormalX, NormalY);
+	}
+
+	Manifolds.push_back(Manifold);
+}
+
+// Get -1 or 1
+static inline float Sign(float Value) {
+	return Value < 0.0f ? -1.0f : 1.0f;
+}
+
+// Push out along the axis with the least overlap
+static inline bool CollideAABBs(float AX, float AY, float AHalfX, float AHalfY, float BX, float BY, float BHalfX, float BHalfY, float &NormalX, float &NormalY, float &Penetration) {
+	float DeltaX = BX - AX;
+	float DeltaY = BY - AY;
+	float OverlapX = (AHalfX + BHalfX) - std::fabs(DeltaX);
+	float OverlapY = (AHalfY + BHalfY) - std::fabs(DeltaY);
+	if(!(OverlapX > 0.0f && OverlapY > 0.0f))
+		return false;
+
+	bool AxisX = OverlapX < OverlapY;
+	NormalX = AxisX ? Sign(DeltaX) : 0.0f;
+	NormalY = AxisX ? 0.0f : Sign(DeltaY);
+	Penetration = AxisX ? OverlapX : OverlapY;
+
+	return true;
+}
+
+// Push out along the line between centers
+static inline bool CollideCircles(float AX, float AY, float ARadius, float BX, float BY, float BRadius, float &NormalX, float &NormalY, float &Penetration) {
+	float DeltaX = BX - AX;
+	float DeltaY = BY - AY;
+	float Radius = ARadius + BRadius;
+	float DistanceSquared = DeltaX * DeltaX + DeltaY * DeltaY;
+	if(!(DistanceSquared < Radius * Radius))
+		return false;
+
+	float Distance = std::sqrt(DistanceSquared);
+	bool Zero = Distance == 0.0f;
+	NormalX = Zero ? 1.0f : DeltaX / Distance;
+	NormalY = Zero ? 0.0f : DeltaY / Distance;
+	Penetration = Radius - Distance;
+
+	return true;
+}
+
+// Push out from the closest point on the box, or along the nearest face if the center is inside
+static inline bool CollideAABBCircle(float AX, float AY, float AHalfX, float AHalfY, float BX, float BY, float BRadius, float &NormalX, float &NormalY, float &Penetration) {
+	float DeltaX = BX - AX;
+	float DeltaY = BY - AY;
+	bool Inside = std::fabs(DeltaX) <= AHalfX && std::fabs(DeltaY) <= AHalfY;
+	if(Inside) {
+		float OverlapX = (AHalfX - std::fabs(DeltaX)) + BRadius;
+		float OverlapY = (AHalfY - std::fabs(DeltaY)) + BRadius;
+		bool AxisX = OverlapX < OverlapY;
+		NormalX = AxisX ? Sign(DeltaX) : 0.0f;
+		NormalY = AxisX ? 0.0f : Sign(DeltaY);
+		Penetration = AxisX ? OverlapX : OverlapY;
+
+		return true;
+	}
+
+	float OffsetX = DeltaX - std::min(std::max(DeltaX, -AHalfX), AHalfX);
+	float OffsetY = DeltaY - std::min(std::max(DeltaY, -AHalfY), AHalfY);
+	float DistanceSquared = OffsetX * OffsetX + OffsetY * OffsetY;
+	if(!(DistanceSquared < BRadius * BRadius))
+		return false;
+
+	float Distance = std::sqrt(DistanceSquared);
+	NormalX = OffsetX / Distance;
+	NormalY = OffsetY / Distance;
+	Penetration = BRadius - Distance;
+
+	return true;
+}
+
+// Test pairs one at a time starting at Start
+static void CollideScalar(const _ShapePairs &Pairs, PairType Type, std::size_t Start, std::vector<_Manifold> &Manifolds) {
+	float NormalX, NormalY, Penetration;
+	for(std::size_t i = Start; i < Pairs.GetCount(); i++) {
+		bool Hit;
+		switch(Type) {
+			case PairType::AABB_AABB:
+				Hit = CollideAABBs(Pairs.AX[i], Pairs.AY[i], Pairs.AHalfX[i], Pairs.AHalfY[i], Pairs.BX[i], Pairs.BY[i], Pairs.BHalfX[i], Pairs.BHalfY[i], NormalX, NormalY, Penetration);
+			break;
+			case PairType::CIRCLE_CIRCLE:
+				Hit = CollideCircles(Pairs.AX[i], Pairs.AY[i], Pairs.AHalfX[i], Pairs.BX[i], Pairs.BY[i], Pairs.BHalfX[i], NormalX, NormalY, Penetration);
+			break;
+			default:
+				Hit = CollideAABBCircle(Pairs.AX[i], Pairs.AY[i], Pairs.AHalfX[i], Pairs.AHalfY[i], Pairs.BX[i], Pairs.BY[i], Pairs.BHalfX[i], NormalX, NormalY, Penetration);
+			break;
+		}
+
+		if(Hit)
+			AddManifold(Pairs, i, NormalX, NormalY, Penetration, Manifolds);
+	}
+}
+
+#if NARROWPHASE_SSE2
+
+static inline __m128 Abs4(__m128 Value) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), Value); }
+static inline __m128 Select4(__m128 Mask, __m128 A, __m128 B) { return _mm_or_ps(_mm_and_ps(Mask, A), _mm_andnot_ps(Mask, B)); }
+static inline __m128 Sign4(__m128 Value) { return Select4(_mm_cmplt_ps(Value, _mm_setzero_ps()), _mm_set1_ps(-1.0f), _mm_set1_ps(1.0f)); }
+
+// Test 4 pairs at a time, returns the index where the scalar tail starts
+static std::size_t CollideSSE2(const _ShapePairs &Pairs, PairType Type, std::vector<_Manifold> &Manifolds) {
+	std::size_t Count = Pairs.GetCount() & ~(std::size_t)3;
+	const __m128 Zero = _mm_setzero_ps();
+	const __m128 One = _mm_set1_ps(1.0f);
+	for(std::size_t i = 0; i < Count; i += 4) {
+		__m128 DeltaX = _mm_sub_ps(_mm_loadu_ps(&Pairs.BX[i]), _mm_loadu_ps(&Pairs.AX[i]));
+		__m128 DeltaY = _mm_sub_ps(_mm_loadu_ps(&Pairs.BY[i]), _mm_loadu_ps(&Pairs.AY[i]));
+		__m128 AHalfX = _mm_loadu_ps(&Pairs.AHalfX[i]);
+		__m128 AHalfY = _mm_loadu_ps(&Pairs.AHalfY[i]);
+		__m128 BHalfX = _mm_loadu_ps(&Pairs.BHalfX[i]);
+		__m128 Hit, NormalX, NormalY, Penetration;
+		switch(Type) {
+			case PairType::AABB_AABB: {
+				__m128 OverlapX = _mm_sub_ps(_mm_add_ps(AHalfX, BHalfX), Abs4(DeltaX));
+				__m128 OverlapY = _mm_sub_ps(_mm_add_ps(AHalfY, _mm_loadu_ps(&Pairs.BHalfY[i])), Abs4(DeltaY));
+				Hit = _mm_and_ps(_mm_cmpgt_ps(OverlapX, Zero), _mm_cmpgt_ps(OverlapY, Zero));
+				__m128 AxisX = _mm_cmplt_ps(OverlapX, OverlapY);
+				NormalX = _mm_and_ps(AxisX, Sign4(DeltaX));
+				NormalY = _mm_andnot_ps(AxisX, Sign4(DeltaY));
+				Penetration = Select4(AxisX, OverlapX, OverlapY);
+			} break;
+			case PairType::CIRCLE_CIRCLE: {
+				__m128 Radius = _mm_add_ps(AHalfX, BHalfX);
+				__m128 DistanceSquared = _mm_add_ps(_mm_mul_ps(DeltaX, DeltaX), _mm_mul_ps(DeltaY, DeltaY));
+				Hit = _mm_cmplt_ps(DistanceSquared, _mm_mul_ps(Radius, Radius));
+				__m128 Distance = _mm_sqrt_ps(DistanceSquared);
+				__m128 IsZero = _mm_cmpeq_ps(Distance, Zero);
+				NormalX = Select4(IsZero, One, _mm_div_ps(DeltaX, Distance));
+				NormalY = _mm_andnot_ps(IsZero, _mm_div_ps(DeltaY, Distance));
+				Penetration = _mm_sub_ps(Radius, Distance);
+			} break;
+			default: {
+				__m128 AbsX = Abs4(DeltaX);
+				__m128 AbsY = Abs4(DeltaY);
+				__m128 Inside = _mm_and_ps(_mm_cmple_ps(AbsX, AHalfX), _mm_cmple_ps(AbsY, AHalfY));
+
+				// Center inside box
+				__m128 OverlapX = _mm_add_ps(_mm_sub_ps(AHalfX, AbsX), BHalfX);
+				__m128 OverlapY = _mm_add_ps(_mm_sub_ps(AHalfY, AbsY), BHalfX);
+				__m128 AxisX = _mm_cmplt_ps(OverlapX, OverlapY);
+				__m128 InsideX = _mm_and_ps(AxisX, Sign4(DeltaX));
+				__m128 InsideY = _mm_andnot_ps(AxisX, Sign4(DeltaY));
+				__m128 InsidePenetration = Select4(AxisX, OverlapX, OverlapY);
+
+				// Center outside box
+				__m128 OffsetX = _mm_sub_ps(DeltaX, _mm_min_ps(_mm_max_ps(DeltaX, _mm_sub_ps(Zero, AHalfX)), AHalfX));
+				__m128 OffsetY = _mm_sub_ps(DeltaY, _mm_min_ps(_mm_max_ps(DeltaY, _mm_sub_ps(Zero, AHalfY)), AHalfY));
+				__m128 DistanceSquared = _mm_add_ps(_mm_mul_ps(OffsetX, OffsetX), _mm_mul_ps(OffsetY, OffsetY));
+				__m128 Distance = _mm_sqrt_ps(DistanceSquared);
+
+				Hit = _mm_or_ps(Inside, _mm_cmplt_ps(DistanceSquared, _mm_mul_ps(BHalfX, BHalfX)));
+				NormalX = Select4(Inside, InsideX, _mm_div_ps(OffsetX, Distance));
+				NormalY = Select4(Inside, InsideY, _mm_div_ps(OffsetY, Distance));
+				Penetration = Select4(Inside, InsidePenetration, _mm_sub_ps(BHalfX, Distance));
+			} break;
+		}
+
+		int Mask = _mm_movemask_ps(Hit);
+		if(!Mask)
+			continue;
+
+		float StoreX[4], StoreY[4], StorePenetration[4];
+		_mm_storeu_ps(StoreX, NormalX);
+		_mm_storeu_ps(StoreY, NormalY);
+		_mm_storeu_ps(StorePenetration, Penetration);
+		for(int Lane = 0; Lane < 4; Lane++) {
+			if(Mask & (1 << Lane))
+				AddManifold(Pairs, i + Lane, StoreX[Lane], StoreY[Lane], StorePenetration[Lane], Manifolds);
+		}
+	}
+
+	return Count;
+}
+
+#endif
+
+#if NARROWPHASE_AVX2
+
+__attribute__((target("avx2"))) static inline __m256 Abs8(__m256 Value) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), Value); }
+__attribute__((target("avx2"))) static inline __m256 Select8(__m256 Mask, __m256 A, __m256 B) { return _mm256_blendv_ps(B, A, Mask); }
+__attribute__((target("avx2"))) static inline __m256 Sign8(__m256 Value) { return Select8(_mm256_cmp_ps(Value, _mm256_setzero_ps(), _CMP_LT_OQ), _mm256_set1_ps(-1.0f), _mm256_set1_ps(1.0f)); }
+
+// Test 8 pairs at a time, returns the index where the scalar tail starts
+__attribute__((target("avx2"))) static std::size_t CollideAVX2(const _ShapePairs &Pairs, PairType Type, std::vector<_Manifold> &Manifolds) {
+	std::size_t Count = Pairs.GetCount() & ~(std::size_t)7;
+	const __m256 Zero = _mm256_setzero_ps();
+	const __m256 One = _mm256_set1_ps(1.0f);
+	for(std::size_t i = 0; i < Count; i += 8) {
+		__m256 DeltaX = _mm256_sub_ps(_mm256_loadu_ps(&Pairs.BX[i]), _mm256_loadu_ps(&Pairs.AX[i]));
+		__m256 DeltaY = _mm256_sub_ps(_mm256_loadu_ps(&Pairs.BY[i]), _mm256_loadu_ps(&Pairs.AY[i]));
+		__m256 AHalfX = _mm256_loadu_ps(&Pairs.AHalfX[i]);
+		__m256 AHalfY = _mm256_loadu_ps(&Pairs.AHalfY[i]);
+		__m256 BHalfX = _mm256_loadu_ps(&Pairs.BHalfX[i]);
+		__m256 Hit, NormalX, NormalY, Penetration;
+		switch(Type) {
+			case PairType::AABB_AABB: {
+				__m256 OverlapX = _mm256_sub_ps(_mm256_add_ps(AHalfX, BHalfX), Abs8(DeltaX));
+				__m256 OverlapY = _mm256_sub_ps(_mm256_add_ps(AHalfY, _mm256_loadu_ps(&Pairs.BHalfY[i])), Abs8(DeltaY));
+				Hit = _mm256_and_ps(_mm256_cmp_ps(OverlapX, Zero, _CMP_GT_OQ), _mm256_cmp_ps(OverlapY, Zero, _CMP_GT_OQ));
+				__m256 AxisX = _mm256_cmp_ps(OverlapX, OverlapY, _CMP_LT_OQ);
+				NormalX = _mm256_and_ps(AxisX, Sign8(DeltaX));
+				NormalY = _mm256_andnot_ps(AxisX, Sign8(DeltaY));
+				Penetration = Select8(AxisX, OverlapX, OverlapY);
+			} break;
+			case PairType::CIRCLE_CIRCLE: {
+				__m256 Radius = _mm256_add_ps(AHalfX, BHalfX);
+				__m256 DistanceSquared = _mm256_add_ps(_mm256_mul_ps(DeltaX, DeltaX), _mm256_mul_ps(DeltaY, DeltaY));
+				Hit = _mm256_cmp_ps(DistanceSquared, _mm256_mul_ps(Radius, Radius), _CMP_LT_OQ);
+				__m256 Distance = _mm256_sqrt_ps(DistanceSquared);
+				__m256 IsZero = _mm256_cmp_ps(Distance, Zero, _CMP_EQ_OQ);
+				NormalX = Select8(IsZero, One, _mm256_div_ps(DeltaX, Distance));
+				NormalY = _mm256_andnot_ps(IsZero, _mm256_div_ps(DeltaY, Distance));
+				Penetration = _mm256_sub_ps(Radius, Distance);
+			} break;
+			default: {
+				__m256 AbsX = Abs8(DeltaX);
+				__m256 AbsY = Abs8(DeltaY);
+				__m256 Inside = _mm256_and_ps(_mm256_cmp_ps(AbsX, AHalfX, _CMP_LE_OQ), _mm256_cmp_ps(AbsY, AHalfY, _CMP_LE_OQ));
+
+				// Center inside box
+				__m256 OverlapX = _mm256_add_ps(_mm256_sub_ps(AHalfX, AbsX), BHalfX);
+				__m256 OverlapY = _mm256_add_ps(_mm256_sub_ps(AHalfY, AbsY), BHalfX);
+				__m256 AxisX = _mm256_cmp_ps(OverlapX, OverlapY, _CMP_LT_OQ);
+				__m256 InsideX = _mm256_and_ps(AxisX, Sign8(DeltaX));
+				__m256 InsideY = _mm256_andnot_ps(AxisX, Sign8(DeltaY));
+				__m256 InsidePenetration = Select8(AxisX, OverlapX, OverlapY);
+
+				// Center outside box
+				__m256 OffsetX = _mm256_sub_ps(DeltaX, _mm256_min_ps(_mm256_max_ps(DeltaX, _mm256_sub_ps(Zero, AHalfX)), AHalfX));
+				__m256 OffsetY = _mm256_sub_ps(DeltaY, _mm256_min_ps(_mm256_max_ps(DeltaY, _mm256_sub_ps(Zero, AHalfY)), AHalfY));
+				__m256 DistanceSquared = _mm256_add_ps(_mm256_mul_ps(OffsetX, OffsetX), _mm256_mul_ps(OffsetY, OffsetY));
+				__m256 Distance = _mm256_sqrt_ps(DistanceSquared);
+
+				Hit = _mm256_or_ps(Inside, _mm256_cmp_ps(DistanceSquared, _mm256_mul_ps(BHalfX, BHalfX), _CMP_LT_OQ));
+				NormalX = Select8(Inside, InsideX, _mm256_div_ps(OffsetX, Distance));
+				NormalY = Select8(Inside, InsideY, _mm256_div_ps(OffsetY, Distance));
+				Penetration = Select8(Inside, InsidePenetration, _mm256_sub_ps(BHalfX, Distance));
+			} break;
+		}
+
+		int Mask = _mm256_movemask_ps(Hit);
+		if(!Mask)
+			continue;
+
+		float StoreX[8], StoreY[8], StorePenetration[8];
+		_mm256_storeu_ps(StoreX, NormalX);
+		_mm256_storeu_ps(StoreY, NormalY);
+		_mm256_storeu_ps(StorePenetration, Penetration);
+		for(int Lane = 0; Lane < 8; Lane++) {
+			if(Mask & (1 << Lane))
+				AddManifold(Pairs, i + Lane, StoreX[Lane], StoreY[Lane], StorePenetration[Lane], Manifolds);
+		}
+	}
+
+	return Count;
+}
+
+#endif
+
+// Run one kernel on a list of pairs
+static void CollidePairs(const _ShapePairs &Pairs, PairType Type, _Narrowphase::Kernel Kernel, std::vector<_Manifold> &Manifolds) {
+	std::size_t Start = 0;
+	switch(Kernel) {
+#if NARROWPHASE_AVX2
+		case _Narrowphase::Kernel::AVX2:
+			Start = CollideAVX2(Pairs, Type, Manifolds);
+		break;
+#endif
+#if NARROWPHASE_SSE2
+		case _Narrowphase::Kernel::SSE2:
+			Start = CollideSSE2(Pairs, Type, Manifolds);
+		break;
+#endif
+		default:
+		break;
+	}
+
+	CollideScalar(Pairs, Type, Start, Manifolds);
+}
+
+// Determine if a kernel can run on this cpu
+bool _Narrowphase::IsSupported(Kernel Type) {
+	switch(Type) {
+		case Kernel::SSE2:
+#if NARROWPHASE_SSE2
+			return true;
+#else
+			return false;
+#endif
+		case Kernel::AVX2:
+#if NARROWPHASE_AVX2
+			return __builtin_cpu_supports("avx2");
+#else
+			return false;
+#endif
+		default:
+			return true;
+	}
+}
+
+// Test all pairs in a batch
+void _Narrowphase::Collide(const _CollisionBatch &Batch, std::vector<_Manifold> &Manifolds, Kernel Type) {
+
+	// Pick the widest supported kernel
+	if(Type == Kernel::AUTO)
+		Type = IsSupported(Kernel::AVX2) ? Kernel::AVX2 : (IsSupported(Kernel::SSE2) ? Kernel::SSE2 : Kernel::SCALAR);
+	else if(!IsSupported(Type))
+		Type = Kernel::SCALAR;
+
+	CollidePairs(Batch.AABBs, PairType::AABB_AABB, Type, Manifolds);
+	CollidePairs(Batch.Circles, PairType::CIRCLE_CIRCLE, Type, Manifolds);
+	CollidePairs(Batch.Mixed, PairType::AABB_CIRCLE, Type, Manifolds);
+}
+
+// Test one pair of shapes
+bool _Narrowphase::Collide(const glm::vec2 &PositionA, const _Shape &ShapeA, const glm::vec2 &PositionB, const _Shape &ShapeB, _Manifold &Manifold) {
+	float NormalX, NormalY, Penetration;
+	bool Hit;
+	if(ShapeA.IsAABB() && ShapeB.IsAABB())
+		Hit = CollideAABBs(PositionA.x, PositionA.y, ShapeA.HalfSize.x, ShapeA.HalfSize.y, PositionB.x, PositionB.y, ShapeB.HalfSize.x, ShapeB.HalfSize.y, NormalX, NormalY, Penetration);
+	else if(!ShapeA.IsAABB() && !ShapeB.IsAABB())
+		Hit = CollideCircles(PositionA.x, PositionA.y, ShapeA.HalfSize.x, PositionB.x, PositionB.y, ShapeB.HalfSize.x, NormalX, NormalY, Penetration);
+	else if(ShapeA.IsAABB())
+		Hit = CollideAABBCircle(PositionA.x, PositionA.y, ShapeA.HalfSize.x, ShapeA.HalfSize.y, PositionB.x, PositionB.y, ShapeB.HalfSize.x, NormalX, NormalY, Penetration);
+	else {
+		Hit = CollideAABBCircle(PositionB.x, PositionB.y, ShapeB.HalfSize.x, ShapeB.HalfSize.y, PositionA.x, PositionA.y, ShapeA.HalfSize.x, NormalX, NormalY, Penetration);
+		NormalX = -NormalX;
+		NormalY = -NormalY;
+	}
+
+	if(!Hit)
+		return false;
+
+	Manifold.Normal = glm::vec2(NormalX, NormalY);
+	Manifold.Penetration = Penetration;
+
+	return true;
+}
+
+// Time a kernel in nanoseconds per pair
+static double TimeKernel(const _CollisionBatch &Batch, _Narrowphase::Kernel Kernel, int Iterations, std::vector<_Manifold> &Manifolds) {
+	auto Start = std::chrono::steady_clock::now();
+	for(int i = 0; i < Iterations; i++) {
+		Manifolds.clear();
+		_Narrowphase::Collide(Batch, Manifolds, Kernel);
+	}
+	double Time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count();
+
+	return Batch.GetCount() && Iterations > 0 ? Time / ((double)Batch.GetCount() * Iterations) : 0.0;
+}
+
+// Compare manifolds from two kernels
+static bool SameManifolds(const std::vector<_Manifold> &A, const std::vector<_Manifold> &B) {
+	if(A.size() != B.size())
+		return false;
+
+	for(std::size_t i = 0; i < A.size(); i++) {
+		if(A[i].ObjectA != B[i].ObjectA || A[i].ObjectB != B[i].ObjectB || A[i].Normal != B[i].Normal || A[i].Penetration != B[i].Penetration)
+			return false;
+	}
+
+	return true;
+}
+
+// Time the scalar and SIMD kernels on a batch and check they agree
+_NarrowphaseStats _Narrowphase::Benchmark(const _CollisionBatch &Batch, int Iterations) {
+	_NarrowphaseStats Stats;
+	Stats.Pairs = Batch.GetCount();
+
+	std::vector<_Manifold> Reference;
+	std::vector<_Manifold> Manifolds;
+	Stats.ScalarTime = TimeKernel(Batch, Kernel::SCALAR, Iterations, Reference);
+	Stats.Contacts = Reference.size();
+
+	if(IsSupported(Kernel::SSE2)) {
+		Stats.SSE2Time = TimeKernel(Batch, Kernel::SSE2, Iterations, Manifolds);
+		Stats.Matches = Stats.Matches && SameManifolds(Reference, Manifolds);
+	}
+
+	if(IsSupported(Kernel::AVX2)) {
+		Stats.AVX2Time = TimeKernel(Batch, Kernel::AVX2, Iterations, Manifolds);
+		Stats.Matches = Stats.Matches && SameManifolds(Reference, Manifolds);
+	}
+
+	return Stats;
+}
+
+// Write stats as a json object
+void _NarrowphaseStats::WriteJSON(std::ostream &Stream) const {
+	Stream << "{\n";
+	Stream << "\t\"pairs\": " << Pairs << ",\n";
+	Stream << "\t\"contacts\": " << Contacts << ",\n";
+	Stream << "\t\"scalar_ns_per_pair\": " << ScalarTime << ",\n";
+	Stream << "\t\"sse2_ns_per_pair\": " << SSE2Time << ",\n";
+	Stream << "\t\"avx2_ns_per_pair\": " << AVX2Time << ",\n";
+	Stream << "\t\"matches\": " << (Matches ? "true" : "false") << "\n";
+	Stream << "}\n";
+}
+
+}
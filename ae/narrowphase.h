@@ -0,0 +1,102 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ae/physics.h>
+#include <glm/vec2.hpp>
+#include <ostream>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace ae {
+
+// Shape pairs of one kind stored as arrays. Circles keep their radius in HalfX.
+struct _ShapePairs {
+	void Clear();
+	std::size_t GetCount() const { return AX.size(); }
+
+	std::vector<float> AX, AY, AHalfX, AHalfY;
+	std::vector<float> BX, BY, BHalfX, BHalfY;
+	std::vector<void *> ObjectA;
+	std::vector<void *> ObjectB;
+
+	// Circle-AABB pairs are stored as AABB-circle and flipped back in the manifold
+	std::vector<uint8_t> Swapped;
+};
+
+// Pairs from the broadphase sorted by shape kind
+class _CollisionBatch {
+
+	public:
+
+		void Add(const glm::vec2 &PositionA, const _Shape &ShapeA, void *ObjectA, const glm::vec2 &PositionB, const _Shape &ShapeB, void *ObjectB);
+		void Clear();
+		std::size_t GetCount() const { return AABBs.GetCount() + Circles.GetCount() + Mixed.GetCount(); }
+
+		_ShapePairs AABBs;
+		_ShapePairs Circles;
+		_ShapePairs Mixed;
+
+};
+
+// Narrowphase timings from Benchmark, in nanoseconds per pair
+struct _NarrowphaseStats {
+	_NarrowphaseStats() : Pairs(0), Contacts(0), ScalarTime(0.0), SSE2Time(0.0), AVX2Time(0.0), Matches(true) { }
+
+	void WriteJSON(std::ostream &Stream) const;
+
+	std::size_t Pairs;
+	std::size_t Contacts;
+	double ScalarTime;
+	double SSE2Time;
+	double AVX2Time;
+
+	// SIMD results are the same as scalar
+	bool Matches;
+};
+
+// Collision tests that fill _Manifold. Normals point from A to B and Penetration is the overlap depth.
+class _Narrowphase {
+
+	public:
+
+		enum class Kernel {
+			AUTO,
+			SCALAR,
+			SSE2,
+			AVX2,
+		};
+
+		// Add a manifold for every colliding pair in the batch
+		static void Collide(const _CollisionBatch &Batch, std::vector<_Manifold> &Manifolds, Kernel Type=Kernel::AUTO);
+
+		// Test one pair
+		static bool Collide(const glm::vec2 &PositionA, const _Shape &ShapeA, const glm::vec2 &PositionB, const _Shape &ShapeB, _Manifold &Manifold);
+
+		static bool IsSupported(Kernel Type);
+
+		// Time each kernel on a batch
+		static _NarrowphaseStats Benchmark(const _CollisionBatch &Batch, int Iterations=100);
+
+};
+
+}
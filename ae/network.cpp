@@ -20,16 +20,25 @@
 #include <ae/network.h>
 #include <ae/peer.h>
 #include <ae/buffer.h>
+#include <ae/buffer_pool.h>
+#include <ae/compression.h>
+#include <ae/random.h>
 #include <enet/enet.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <stdexcept>
 
 namespace ae {
 
 // Constructor
-_Network::_Network() :
+_Network::_Network(bool UsePingSocket) :
 	Connection(nullptr),
 	PingSocket(-1),
 	Time(0.0),
+	PacketHeaders(false),
+	Compressor(nullptr),
+	CompressionThreshold(256),
 	UpdateTimer(0.0),
 	UpdatePeriod(1 / 20.0),
 	SentSpeed(0),
@@ -37,21 +46,32 @@ _Network::_Network() :
 	SecondTimer(0.0),
 	FakeLag(0.0) {
 
+	NetworkEvents.Init(256);
+	DelayedPackets.Init(256);
+
 	// Create ping socket
-	PingSocket = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
+	if(UsePingSocket)
+		PingSocket = enet_socket_create(ENET_SOCKET_TYPE_DATAGRAM);
 }
 
 // Destructor
 _Network::~_Network() {
 
 	// Delete events
-	while(!NetworkEvents.empty()) {
-		delete NetworkEvents.front().Data;
-		NetworkEvents.pop();
+	while(!NetworkEvents.IsEmpty()) {
+		BufferPool.Release(NetworkEvents.Front().Data);
+		NetworkEvents.Pop();
+	}
+
+	// Delete simulated packets
+	while(!DelayedPackets.IsEmpty()) {
+		enet_packet_destroy(DelayedPackets.Front().Packet);
+		DelayedPackets.Pop();
 	}
 
 	// Destroy socket
-	enet_socket_destroy(PingSocket);
+	if(PingSocket != -1)
+		enet_socket_destroy(PingSocket);
 
 	// Destroy connection
 	if(Connection)
@@ -73,11 +93,11 @@ void _Network::CloseSystem() {
 bool _Network::GetNetworkEvent(_NetworkEvent &NetworkEvent) {
 
 	// Check for new events
-	if(!NetworkEvents.empty()) {
-		const _NetworkEvent &PeekEvent = NetworkEvents.front();
+	if(!NetworkEvents.IsEmpty()) {
+		const _NetworkEvent &PeekEvent = NetworkEvents.Front();
 		if(Time >= PeekEvent.Time) {
-			NetworkEvent = NetworkEvents.front();
-			NetworkEvents.pop();
+			NetworkEvent = PeekEvent;
+			NetworkEvents.Pop();
 			return true;
 		}
 	}
@@ -85,10 +105,129 @@ bool _Network::GetNetworkEvent(_NetworkEvent &NetworkEvent) {
 	return false;
 }
 
+// Copy up to MaxEvents ready events into an array and return the count
+std::size_t _Network::DrainEvents(_NetworkEvent *Events, std::size_t MaxEvents) {
+	std::size_t Count = 0;
+	while(Count < MaxEvents && !NetworkEvents.IsEmpty() && Time >= NetworkEvents.Front().Time) {
+		Events[Count++] = NetworkEvents.Front();
+		NetworkEvents.Pop();
+	}
+
+	return Count;
+}
+
+// Add a received event to the queue through the simulated link
+void _Network::QueueEvent(_NetworkEvent &Event, bool Reliable) {
+	if(IncomingConditions.IsActive())
+		SimulateReceive(Event, Reliable);
+	else
+		AddEvent(Event);
+}
+
+// Read a variable length integer from raw packet data, returns false if it runs past the end
+static bool ReadPacketVarInt(const uint8_t *Data, std::size_t Size, std::size_t &Offset, uint64_t &Value) {
+	Value = 0;
+	for(int Shift = 0; Shift < 64 && Offset < Size; Shift += 7) {
+		uint8_t Group = Data[Offset++];
+		Value |= (uint64_t)(Group & 0x7F) << Shift;
+		if(!(Group & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+// Queue events for a received packet, splitting batched packets into one event per message
+void _Network::QueuePacket(_NetworkEvent &Event, bool Reliable, ENetPacket *Packet) {
+	if(!PacketHeaders) {
+		Event.Data = CreatePacketBuffer(Packet);
+		QueueEvent(Event, Reliable);
+		return;
+	}
+
+	// Drop packets without a header
+	if(!Packet->dataLength) {
+		enet_packet_destroy(Packet);
+		return;
+	}
+
+	uint8_t Flags = Packet->data[0];
+	if(Flags & COMPRESSED) {
+		Event.Data = DecompressPacket(Packet);
+		if(Event.Data)
+			QueueEvent(Event, Reliable);
+		return;
+	}
+
+	if(!(Flags & BATCHED)) {
+		Event.Data = CreatePacketBuffer(Packet, 1, Packet->dataLength - 1);
+		QueueEvent(Event, Reliable);
+		return;
+	}
+
+	// Count messages, a bad length drops the rest of the packet
+	std::size_t Count = 0;
+	std::size_t Offset = 1;
+	uint64_t Size;
+	while(Offset < Packet->dataLength && ReadPacketVarInt(Packet->data, Packet->dataLength, Offset, Size) && Size <= Packet->dataLength - Offset) {
+		Offset += Size;
+		Count++;
+	}
+
+	if(!Count) {
+		enet_packet_destroy(Packet);
+		return;
+	}
+
+	// Each message buffer holds a reference to the packet
+	Packet->referenceCount = Count;
+	Offset = 1;
+	for(std::size_t i = 0; i < Count; i++) {
+		ReadPacketVarInt(Packet->data, Packet->dataLength, Offset, Size);
+		_NetworkEvent MessageEvent = Event;
+		MessageEvent.Data = CreatePacketBuffer(Packet, Offset, Size);
+		QueueEvent(MessageEvent, Reliable);
+		Offset += Size;
+	}
+}
+
+// Decompress a packet into a pooled buffer and destroy it, returns null on bad data
+_Buffer *_Network::DecompressPacket(ENetPacket *Packet) {
+	std::size_t Offset = 1;
+	uint64_t Size;
+	bool Valid = Compressor && ReadPacketVarInt(Packet->data, Packet->dataLength, Offset, Size);
+
+	// Compressed data can't expand more than 255 times
+	_Buffer *Buffer = nullptr;
+	if(Valid && Size <= (Packet->dataLength - Offset) * 255) {
+		Buffer = BufferPool.Acquire(Size);
+		if(Compressor->Decompress(Packet->data + Offset, Packet->dataLength - Offset, &(*Buffer)[0], Size)) {
+			Buffer->SetAllocatedSize(Size);
+			Buffer->StartRead();
+		}
+		else {
+			BufferPool.Release(Buffer);
+			Buffer = nullptr;
+		}
+	}
+
+	enet_packet_destroy(Packet);
+
+	return Buffer;
+}
+
+// Add event to queue, keeping it sorted by time
+void _Network::AddEvent(const _NetworkEvent &Event) {
+	if(NetworkEvents.IsFull())
+		NetworkEvents.Resize(NetworkEvents.Capacity() * 2);
+
+	// Move later events back
+	NetworkEvents.PushBack(Event);
+	NetworkEvents.SortBack([](const _NetworkEvent &A, const _NetworkEvent &B) { return A.Time < B.Time; });
+}
+
 // Update
 void _Network::Update(double FrameTime) {
-	if(!Connection)
-		return;
 
 	// Update time
 	Time += FrameTime;
@@ -97,29 +236,61 @@ void _Network::Update(double FrameTime) {
 
 	// Get events from enet
 	ENetEvent EEvent;
-	while(enet_host_service(Connection, &EEvent, 0) > 0) {
+	while(GetENetEvent(EEvent)) {
 
 		// Create a _NetworkEvent
 		_NetworkEvent Event;
 		CreateEvent(Event, Time + FakeLag, EEvent);
 
 		// Handle internally
+		bool Reliable = EEvent.type != ENET_EVENT_TYPE_RECEIVE || (EEvent.packet->flags & ENET_PACKET_FLAG_RELIABLE);
 		HandleEvent(Event, EEvent);
 
 		// Add to queue
-		NetworkEvents.push(Event);
+		if(Event.Type == _NetworkEvent::PACKET)
+			QueuePacket(Event, Reliable, EEvent.packet);
+		else
+			QueueEvent(Event, Reliable);
 	}
 
+	// Get events from in-memory connections
+	ReceiveLoopbackEvents();
+
+	// Send packets that made it through the simulated link
+	SendDelayedPackets();
+
 	// Update speed variables
 	if(SecondTimer >= 1.0) {
-		SentSpeed = Connection->totalSentData / SecondTimer;
-		ReceiveSpeed = Connection->totalReceivedData / SecondTimer;
-		Connection->totalSentData = 0;
-		Connection->totalReceivedData = 0;
+		uint32_t SentData;
+		uint32_t ReceivedData;
+		TakeDataTotals(SentData, ReceivedData);
+		SentSpeed = SentData / SecondTimer;
+		ReceiveSpeed = ReceivedData / SecondTimer;
+		UpdatePeerStats(SecondTimer);
 		SecondTimer -= 1.0;
 	}
 }
 
+// Get next event from enet
+bool _Network::GetENetEvent(ENetEvent &EEvent) {
+	if(!Connection)
+		return false;
+
+	return enet_host_service(Connection, &EEvent, 0) > 0;
+}
+
+// Get and reset data counters
+void _Network::TakeDataTotals(uint32_t &SentData, uint32_t &ReceivedData) {
+	SentData = ReceivedData = 0;
+	if(!Connection)
+		return;
+
+	SentData = Connection->totalSentData;
+	ReceivedData = Connection->totalReceivedData;
+	Connection->totalSentData = 0;
+	Connection->totalReceivedData = 0;
+}
+
 // Check for pings
 bool _Network::CheckPings(_Buffer &Data, _NetworkAddress &NetworkAddress) {
 	if(PingSocket == -1)
@@ -146,6 +317,8 @@ bool _Network::CheckPings(_Buffer &Data, _NetworkAddress &NetworkAddress) {
 
 // Send packet on ping socket
 void _Network::SendPingPacket(const _Buffer &Buffer, const _NetworkAddress &NetworkAddress) {
+	if(PingSocket == -1)
+		return;
 
 	// Set address
 	ENetAddress Address;
@@ -159,9 +332,212 @@ void _Network::SendPingPacket(const _Buffer &Buffer, const _NetworkAddress &Netw
 	enet_socket_send(PingSocket, &Address, &SocketBuffer, 1);
 }
 
+// Create a buffer that reads from the packet directly and destroys it when released
+_Buffer *_Network::CreatePacketBuffer(ENetPacket *Packet) {
+	return BufferPool.AcquireExternal((char *)Packet->data, Packet->dataLength, ReleasePacket, Packet);
+}
+
+// Create a buffer that reads part of an enet packet
+_Buffer *_Network::CreatePacketBuffer(ENetPacket *Packet, std::size_t Offset, std::size_t Size) {
+	return BufferPool.AcquireExternal((char *)Packet->data + Offset, Size, ReleasePacket, Packet);
+}
+
+// Create an enet packet from a buffer, adding a header if needed
+ENetPacket *_Network::CreateENetPacket(const _Buffer &Buffer, SendType Type) {
+	if(!PacketHeaders)
+		return enet_packet_create(Buffer.GetData(), Buffer.GetCurrentSize(), Type);
+
+	// Compress large packets, sending them as is if they don't shrink
+	std::size_t Size = Buffer.GetCurrentSize();
+	if(Compressor && Size >= CompressionThreshold) {
+		CompressionBuffer.resize(_Compressor::GetMaxCompressedSize(Size) + 11);
+		CompressionBuffer[0] = COMPRESSED;
+		std::size_t Offset = 1;
+		for(uint64_t Value = Size; ; Value >>= 7) {
+			CompressionBuffer[Offset++] = (uint8_t)((Value & 0x7F) | (Value >= 0x80 ? 0x80 : 0));
+			if(Value < 0x80)
+				break;
+		}
+
+		std::size_t CompressedSize = Compressor->Compress(Buffer.GetData(), Size, &CompressionBuffer[Offset], CompressionBuffer.size() - Offset);
+		if(CompressedSize)
+			return enet_packet_create(CompressionBuffer.data(), Offset + CompressedSize, Type);
+	}
+
+	ENetPacket *Packet = enet_packet_create(nullptr, Buffer.GetCurrentSize() + 1, Type);
+	Packet->data[0] = 0;
+	if(Buffer.GetCurrentSize())
+		memcpy(Packet->data + 1, Buffer.GetData(), Buffer.GetCurrentSize());
+
+	return Packet;
+}
+
+// Destroy an enet packet adopted by a buffer once the last buffer sharing it is done
+void _Network::ReleasePacket(void *Packet) {
+	ENetPacket *EPacket = (ENetPacket *)Packet;
+	if(EPacket->referenceCount > 1) {
+		EPacket->referenceCount--;
+		return;
+	}
+
+	enet_packet_destroy(EPacket);
+}
+
 // Convert host address to string
 void _NetworkAddress::GetIP(char *IP) {
 	enet_address_get_host_ip((ENetAddress *)this, &IP[0], 16);
 }
 
+// Set simulated link conditions for received and sent packets
+void _Network::SetConditions(const _NetworkConditions &Incoming, const _NetworkConditions &Outgoing, uint32_t Seed) {
+	IncomingConditions = Incoming;
+	OutgoingConditions = Outgoing;
+	IncomingLink = _NetworkLink();
+	OutgoingLink = _NetworkLink();
+	PeerDeliveryTimes.clear();
+
+	// A seed of 0 takes one from the global generator
+	SimulationRandom.seed(Seed ? Seed : RandomGenerator());
+}
+
+// Send a packet, or hold it back if the outgoing link is simulated
+void _Network::SendENetPacket(_ENetPeer *ENetPeer, uint32_t ConnectID, uint8_t Channel, ENetPacket *Packet) {
+	if(!OutgoingConditions.IsActive()) {
+		DeliverPacket(ENetPeer, ConnectID, Channel, Packet);
+		return;
+	}
+
+	// Get delivery time
+	double DeliveryTime;
+	bool Duplicate;
+	bool Reliable = Packet->flags & ENET_PACKET_FLAG_RELIABLE;
+	if(!SimulatePacket(OutgoingConditions, OutgoingLink, Packet->dataLength, Reliable, DeliveryTime, Duplicate)) {
+		enet_packet_destroy(Packet);
+		return;
+	}
+
+	// Queue packet and copy
+	_DelayedPacket DelayedPacket;
+	DelayedPacket.Time = DeliveryTime;
+	DelayedPacket.ENetPeer = ENetPeer;
+	DelayedPacket.ConnectID = ConnectID;
+	DelayedPacket.Channel = Channel;
+	for(int i = 0; i < 1 + Duplicate; i++) {
+		DelayedPacket.Packet = i ? enet_packet_create(Packet->data, Packet->dataLength, Packet->flags) : Packet;
+		DelayedPacket.Time += i ? std::abs(GetJitter(OutgoingConditions)) : 0.0;
+
+		if(DelayedPackets.IsFull())
+			DelayedPackets.Resize(DelayedPackets.Capacity() * 2);
+
+		DelayedPackets.PushBack(DelayedPacket);
+		DelayedPackets.SortBack([](const _DelayedPacket &A, const _DelayedPacket &B) { return A.Time < B.Time; });
+	}
+}
+
+// Send a packet to enet if the peer still has the same connection
+void _Network::DeliverPacket(_ENetPeer *ENetPeer, uint32_t ConnectID, uint8_t Channel, ENetPacket *Packet) {
+	if(!ENetPeer || ENetPeer->connectID != ConnectID || enet_peer_send(ENetPeer, Channel, Packet) != 0)
+		enet_packet_destroy(Packet);
+}
+
+// Send delayed packets that are due
+void _Network::SendDelayedPackets() {
+	while(!DelayedPackets.IsEmpty() && DelayedPackets.Front().Time <= Time) {
+		const _DelayedPacket &DelayedPacket = DelayedPackets.Front();
+		DeliverPacket(DelayedPacket.ENetPeer, DelayedPacket.ConnectID, DelayedPacket.Channel, DelayedPacket.Packet);
+		DelayedPackets.Pop();
+	}
+}
+
+// Apply incoming conditions to a received event
+void _Network::SimulateReceive(_NetworkEvent &Event, bool Reliable) {
+	std::size_t Size = Event.Data ? Event.Data->GetAllocatedSize() : 0;
+
+	// Connect and disconnect are never lost
+	bool Packet = Event.Type == _NetworkEvent::PACKET;
+	Reliable = Reliable || !Packet;
+
+	// Get delivery time
+	double DeliveryTime;
+	bool Duplicate;
+	if(!SimulatePacket(IncomingConditions, IncomingLink, Size, Reliable, DeliveryTime, Duplicate)) {
+		BufferPool.Release(Event.Data);
+		return;
+	}
+
+	// Connect and disconnect wait for every event already scheduled for the peer
+	double &PeerTime = PeerDeliveryTimes[Event.Peer];
+	Event.Time = DeliveryTime + FakeLag;
+	if(!Packet)
+		Event.Time = std::max(Event.Time, PeerTime);
+	PeerTime = std::max(PeerTime, Event.Time);
+
+	// Add copy of packet
+	if(Duplicate && Event.Data) {
+		_NetworkEvent Copy = Event;
+		Copy.Time = Event.Time + std::abs(GetJitter(IncomingConditions));
+		Copy.Data = BufferPool.Acquire(Size);
+		Copy.Data->WriteData(Event.Data->GetData(), Size);
+		Copy.Data->SetAllocatedSize(Size);
+		Copy.Data->StartRead();
+		PeerTime = std::max(PeerTime, Copy.Time);
+		AddEvent(Copy);
+	}
+
+	if(Event.Type == _NetworkEvent::DISCONNECT)
+		PeerDeliveryTimes.erase(Event.Peer);
+
+	AddEvent(Event);
+}
+
+// Get delivery time of a packet sent now on a simulated link, returns false if it was lost
+bool _Network::SimulatePacket(const _NetworkConditions &Conditions, _NetworkLink &Link, std::size_t Size, bool Reliable, double &DeliveryTime, bool &Duplicate) {
+	std::uniform_real_distribution<double> Chance(0.0, 1.0);
+	double Delay = Conditions.Latency + GetJitter(Conditions);
+
+	// Lost reliable packets arrive after enet resends them
+	if(Conditions.Loss > 0.0 && Chance(SimulationRandom) < Conditions.Loss) {
+		if(!Reliable)
+			return false;
+
+		Delay += Conditions.Latency * 2.0;
+	}
+
+	// Hold back some unreliable packets so later ones overtake them
+	if(!Reliable && Conditions.Reorder > 0.0 && Chance(SimulationRandom) < Conditions.Reorder)
+		Delay += Chance(SimulationRandom) * Conditions.ReorderDelay;
+
+	// Wait for link to be free
+	double SendTime = std::max(Link.FreeTime, Time);
+	if(Conditions.Bandwidth > 0.0) {
+		SendTime += Size / Conditions.Bandwidth;
+		Link.FreeTime = SendTime;
+	}
+	DeliveryTime = SendTime + std::max(Delay, 0.0);
+
+	// Reliable packets stay in order
+	if(Reliable) {
+		DeliveryTime = std::max(DeliveryTime, Link.LastReliableTime);
+		Link.LastReliableTime = DeliveryTime;
+	}
+
+	Duplicate = !Reliable && Conditions.Duplicate > 0.0 && Chance(SimulationRandom) < Conditions.Duplicate;
+
+	return true;
+}
+
+// Get random jitter offset
+double _Network::GetJitter(const _NetworkConditions &Conditions) {
+	if(Conditions.Jitter <= 0.0)
+		return 0.0;
+
+	if(Conditions.JitterDistribution == _NetworkConditions::NORMAL) {
+		std::normal_distribution<double> Distribution(0.0, Conditions.Jitter);
+		return Distribution(SimulationRandom);
+	}
+
+	std::uniform_real_distribution<double> Distribution(-Conditions.Jitter, Conditions.Jitter);
+	return Distribution(SimulationRandom);
+}
+
 }
@@ -20,14 +20,20 @@
 #pragma once
 
 // Libraries
+#include <ae/circular_buffer.h>
 #include <list>
-#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
 #include <cstdint>
+#include <cstddef>
 
 // Forward Declarations
+struct _ENetPeer;
 typedef struct _ENetEvent ENetEvent;
 typedef struct _ENetHost ENetHost;
 typedef struct _ENetAddress ENetAddress;
+typedef struct _ENetPacket ENetPacket;
 
 namespace ae {
 
@@ -35,6 +41,7 @@ const uint32_t NETWORK_BROADCAST = 0xFFFFFFFFU;
 
 // Forward Declarations
 class _Buffer;
+class _Compressor;
 class _Peer;
 
 // Network address
@@ -63,10 +70,41 @@ struct _NetworkEvent {
 	EventType Type;
 	double Time;
 	int EventData;
+
+	// Packet data, return with BufferPool.Release when done
 	_Buffer *Data;
 	_Peer *Peer;
 };
 
+// Simulated link impairment for one direction
+struct _NetworkConditions {
+
+	// Jitter distributions
+	enum JitterType {
+		UNIFORM,
+		NORMAL,
+	};
+
+	_NetworkConditions() : Latency(0.0), Jitter(0.0), JitterDistribution(UNIFORM), Loss(0.0), Duplicate(0.0), Reorder(0.0), ReorderDelay(0.0), Bandwidth(0.0) { }
+	bool IsActive() const { return Latency > 0.0 || Jitter > 0.0 || Loss > 0.0 || Duplicate > 0.0 || Reorder > 0.0 || Bandwidth > 0.0; }
+
+	// Seconds of one way delay, jitter is the half range for uniform or standard deviation for normal
+	double Latency;
+	double Jitter;
+	JitterType JitterDistribution;
+
+	// Probabilities from 0 to 1. Lost reliable packets are delayed by a resend instead of dropped.
+	double Loss;
+	double Duplicate;
+	double Reorder;
+
+	// Max extra delay for reordered packets
+	double ReorderDelay;
+
+	// Bytes per second, 0 for unlimited
+	double Bandwidth;
+};
+
 class _Network {
 
 	public:
@@ -77,7 +115,13 @@ class _Network {
 			UNSEQUENCED = 2,
 		};
 
-		_Network();
+		// Flags in the first byte of a packet when packet headers are on
+		enum PacketFlag {
+			BATCHED = 1,
+			COMPRESSED = 2,
+		};
+
+		_Network(bool UsePingSocket=true);
 		virtual ~_Network();
 
 		void Update(double FrameTime);
@@ -85,12 +129,24 @@ class _Network {
 
 		// Settings
 		void SetFakeLag(double Value) { FakeLag = Value; }
+		void SetConditions(const _NetworkConditions &Incoming, const _NetworkConditions &Outgoing, uint32_t Seed);
+		void ClearConditions() { SetConditions(_NetworkConditions(), _NetworkConditions(), 0); }
+		bool IsSimulating() const { return IncomingConditions.IsActive() || OutgoingConditions.IsActive(); }
+
+		// Start each packet with a flags byte, needed for batching. Both ends must use the same setting.
+		void SetPacketHeaders(bool Value) { PacketHeaders = Value; }
+		bool HasPacketHeaders() const { return PacketHeaders; }
+
+		// Compress packets of at least Threshold bytes, needs packet headers. Both ends must use the same dictionary.
+		void SetCompression(_Compressor *Compressor, std::size_t Threshold=256) { this->Compressor = Compressor; CompressionThreshold = Threshold; }
 
 		// Sockets
 		void SendPingPacket(const _Buffer &Buffer, const _NetworkAddress &NetworkAddress);
 
 		// Updates
 		bool GetNetworkEvent(_NetworkEvent &NetworkEvent);
+		std::size_t DrainEvents(_NetworkEvent *Events, std::size_t MaxEvents);
+		template<typename F> std::size_t DrainEvents(F Handler);
 		bool HasConnection() { return Connection != nullptr; }
 
 		// Stats
@@ -116,11 +172,35 @@ class _Network {
 
 		virtual void CreateEvent(_NetworkEvent &Event, double Time, ENetEvent &EEvent) { }
 		virtual void HandleEvent(_NetworkEvent &Event, ENetEvent &EEvent) { }
+		virtual bool GetENetEvent(ENetEvent &EEvent);
+		virtual void TakeDataTotals(uint32_t &SentData, uint32_t &ReceivedData);
+		virtual void ReceiveLoopbackEvents() { }
+		virtual void UpdatePeerStats(double) { }
+		void QueueEvent(_NetworkEvent &Event, bool Reliable);
+		void QueuePacket(_NetworkEvent &Event, bool Reliable, ENetPacket *Packet);
+		void AddEvent(const _NetworkEvent &Event);
+
+		// Send a packet through the simulated link
+		void SendENetPacket(_ENetPeer *ENetPeer, uint32_t ConnectID, uint8_t Channel, ENetPacket *Packet);
+		virtual void DeliverPacket(_ENetPeer *ENetPeer, uint32_t ConnectID, uint8_t Channel, ENetPacket *Packet);
+
+		// Packets
+		ENetPacket *CreateENetPacket(const _Buffer &Buffer, SendType Type);
+		static _Buffer *CreatePacketBuffer(ENetPacket *Packet);
+		static _Buffer *CreatePacketBuffer(ENetPacket *Packet, std::size_t Offset, std::size_t Size);
+		_Buffer *DecompressPacket(ENetPacket *Packet);
+		static void ReleasePacket(void *Packet);
 
 		// State
 		ENetHost *Connection;
 		int PingSocket;
 		double Time;
+		bool PacketHeaders;
+
+		// Compression
+		_Compressor *Compressor;
+		std::size_t CompressionThreshold;
+		std::vector<uint8_t> CompressionBuffer;
 
 		// Updates
 		double UpdateTimer, UpdatePeriod;
@@ -132,7 +212,54 @@ class _Network {
 
 		// Fake lag
 		double FakeLag;
-		std::queue<_NetworkEvent> NetworkEvents;
+
+		// Events sorted by time
+		_CircularBuffer<_NetworkEvent> NetworkEvents;
+
+	private:
+
+		// Packet waiting on the simulated link
+		struct _DelayedPacket {
+			double Time;
+			_ENetPeer *ENetPeer;
+			uint32_t ConnectID;
+			uint8_t Channel;
+			ENetPacket *Packet;
+		};
+
+		// Simulated link state
+		struct _NetworkLink {
+			_NetworkLink() : FreeTime(0.0), LastReliableTime(0.0) { }
+
+			double FreeTime;
+			double LastReliableTime;
+		};
+
+		void SimulateReceive(_NetworkEvent &Event, bool Reliable);
+		bool SimulatePacket(const _NetworkConditions &Conditions, _NetworkLink &Link, std::size_t Size, bool Reliable, double &DeliveryTime, bool &Duplicate);
+		double GetJitter(const _NetworkConditions &Conditions);
+		void SendDelayedPackets();
+
+		// Network simulation
+		_NetworkConditions IncomingConditions;
+		_NetworkConditions OutgoingConditions;
+		_NetworkLink IncomingLink;
+		_NetworkLink OutgoingLink;
+		std::unordered_map<const _Peer *, double> PeerDeliveryTimes;
+		_CircularBuffer<_DelayedPacket> DelayedPackets;
+		std::mt19937 SimulationRandom;
 };
 
+// Call Handler(const _NetworkEvent &) for every event that's ready, then remove them
+template<typename F> std::size_t _Network::DrainEvents(F Handler) {
+	std::size_t Count = 0;
+	while(!NetworkEvents.IsEmpty() && Time >= NetworkEvents.Front().Time) {
+		Handler(NetworkEvents.Front());
+		NetworkEvents.Pop();
+		Count++;
+	}
+
+	return Count;
+}
+
 }
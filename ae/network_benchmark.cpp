@@ -0,0 +1,263 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#include <ae/network_benchmark.h>
+#include <ae/servernetwork.h>
+#include <ae/clientnetwork.h>
+#include <ae/peer.h>
+#include <ae/buffer.h>
+#include <ae/buffer_pool.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace ae {
+
+// Get seconds from a steady clock
+static double GetClockTime() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Connect clients, send packets both ways and measure
+const _NetworkBenchmarkResults &_NetworkBenchmark::Run() {
+	Results = _NetworkBenchmarkResults();
+	Latencies.clear();
+	StartTime = GetClockTime();
+
+	// Create server
+	_ServerNetwork Server(Settings.Clients, Settings.Port);
+	if(!Server.HasConnection())
+		throw std::runtime_error("Benchmark server failed to start");
+	if(Settings.Threaded)
+		Server.StartThread();
+
+	// Create clients
+	std::vector<std::unique_ptr<_ClientNetwork>> Clients;
+	for(int i = 0; i < Settings.Clients; i++) {
+		Clients.emplace_back(new _ClientNetwork());
+		Clients.back()->Connect("127.0.0.1", Server.GetListenPort());
+	}
+
+	// Create packet
+	std::size_t PacketSize = std::max(Settings.PacketSize, sizeof(double));
+	std::vector<char> Padding(PacketSize - sizeof(double), 0);
+	_Buffer Packet(PacketSize);
+
+	double SendPeriod = 1.0 / std::max(Settings.SendRate, 1.0);
+	double SendTimer = 0.0;
+	double MeasureStart = 0.0;
+	double MeasureEnd = 0.0;
+	double LastTime = GetClockTime();
+	double BroadcastClock = 0.0;
+	double EventClock = 0.0;
+	uint64_t Broadcasts = 0;
+	uint64_t ServerEvents = 0;
+	uint64_t ClientPackets = 0;
+	std::vector<_Peer *> Targets;
+	bool Connected = false;
+	while(true) {
+		double Now = GetClockTime();
+		double FrameTime = Now - LastTime;
+		LastTime = Now;
+
+		// Wait for all clients to connect before sending
+		if(!Connected) {
+			Connected = Server.GetPeers().size() == Clients.size();
+			for(auto &Client : Clients)
+				Connected = Connected && Client->IsConnected();
+
+			if(Connected) {
+				MeasureStart = Now + Settings.WarmupTime;
+				MeasureEnd = MeasureStart + Settings.Duration;
+			}
+			else if(Now - StartTime > Settings.ConnectTimeout)
+				throw std::runtime_error("Benchmark clients failed to connect");
+		}
+		else if(Now >= MeasureEnd)
+			break;
+
+		bool Measuring = Connected && Now >= MeasureStart;
+
+		// Send packets
+		if(Connected) {
+			SendTimer += FrameTime;
+			while(SendTimer >= SendPeriod) {
+				SendTimer -= SendPeriod;
+
+				Packet.Reset();
+				Packet.Write<double>(GetClockTime() - StartTime);
+				Packet.WriteData(Padding.data(), Padding.size());
+
+				// Send from server to connected peers, BroadcastPacket skips peers without an object
+				Targets.clear();
+				for(auto &Peer : Server.GetPeers()) {
+					if(Peer->ENetPeer)
+						Targets.push_back(Peer);
+				}
+
+				double BroadcastStart = GetClockTime();
+				Server.MulticastPacket(Packet, Targets, Settings.SendType);
+				if(Measuring) {
+					BroadcastClock += GetClockTime() - BroadcastStart;
+					Broadcasts += Targets.size();
+					Results.PacketsSent += Targets.size();
+				}
+
+				// Send from clients
+				for(auto &Client : Clients) {
+					if(!Client->IsConnected())
+						continue;
+
+					Client->SendPacket(Packet, Settings.SendType);
+					if(Measuring)
+						Results.PacketsSent++;
+				}
+			}
+		}
+
+		// Update server and handle events
+		double EventStart = GetClockTime();
+		Server.Update(FrameTime);
+		std::size_t Count = Server.DrainEvents([&](const _NetworkEvent &Event) {
+			if(Event.Type == _NetworkEvent::DISCONNECT)
+				Server.DeletePeer(Event.Peer);
+			else if(Event.Type == _NetworkEvent::PACKET) {
+				if(Measuring)
+					AddLatency(*Event.Data, GetClockTime());
+				BufferPool.Release(Event.Data);
+			}
+		});
+		if(Measuring) {
+			EventClock += GetClockTime() - EventStart;
+			ServerEvents += Count;
+		}
+
+		// Update clients
+		for(auto &Client : Clients) {
+			Client->Update(FrameTime);
+			Client->DrainEvents([&](const _NetworkEvent &Event) {
+				if(Event.Type == _NetworkEvent::PACKET) {
+					if(Measuring)
+						AddLatency(*Event.Data, GetClockTime());
+					BufferPool.Release(Event.Data);
+					ClientPackets++;
+				}
+			});
+		}
+
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+
+	if(!ClientPackets)
+		throw std::runtime_error("Benchmark clients received no packets from server");
+
+	// Client stats
+	for(auto &Client : Clients) {
+		Results.AverageRTT += Client->GetRTT();
+		Results.PacketsLost += Client->GetPacketsLost();
+	}
+	if(!Clients.empty())
+		Results.AverageRTT /= Clients.size();
+
+	// Throughput
+	Results.Duration = Settings.Duration;
+	if(Results.Duration > 0.0) {
+		Results.PacketsPerSecond = Results.PacketsReceived / Results.Duration;
+		Results.BytesPerSecond = Results.BytesReceived / Results.Duration;
+	}
+	Results.ServerSentSpeed = Server.GetSentSpeed();
+	Results.ServerReceiveSpeed = Server.GetReceiveSpeed();
+
+	// CPU cost per packet
+	if(Broadcasts)
+		Results.BroadcastTime = BroadcastClock / Broadcasts;
+	if(ServerEvents)
+		Results.EventTime = EventClock / ServerEvents;
+
+	// Latency percentiles
+	if(!Latencies.empty()) {
+		std::sort(Latencies.begin(), Latencies.end());
+		double Total = 0.0;
+		for(const auto &Latency : Latencies)
+			Total += Latency;
+
+		Results.LatencyMean = Total / Latencies.size();
+		Results.LatencyP50 = GetPercentile(Latencies, 0.50);
+		Results.LatencyP99 = GetPercentile(Latencies, 0.99);
+		Results.LatencyMax = Latencies.back();
+	}
+
+	return Results;
+}
+
+// Record latency and size of a received benchmark packet
+void _NetworkBenchmark::AddLatency(_Buffer &Buffer, double Now) {
+	Buffer.StartRead();
+	double SendTime = Buffer.Read<double>();
+	if(Buffer.HasError())
+		return;
+
+	Latencies.push_back(Now - StartTime - SendTime);
+	Results.PacketsReceived++;
+	Results.BytesReceived += Buffer.GetAllocatedSize();
+}
+
+// Get nearest rank percentile from a sorted list
+double _NetworkBenchmark::GetPercentile(const std::vector<double> &Sorted, double Percentile) {
+	if(Sorted.empty())
+		return 0.0;
+
+	std::size_t Index = (std::size_t)std::ceil(Percentile * Sorted.size());
+	if(Index > 0)
+		Index--;
+
+	return Sorted[std::min(Index, Sorted.size() - 1)];
+}
+
+// Write settings and results as a json object
+void _NetworkBenchmark::WriteJSON(std::ostream &Stream) const {
+	Stream << "{\n";
+	Stream << "\t\"clients\": " << Settings.Clients << ",\n";
+	Stream << "\t\"packet_size\": " << Settings.PacketSize << ",\n";
+	Stream << "\t\"send_rate\": " << Settings.SendRate << ",\n";
+	Stream << "\t\"reliable\": " << (Settings.SendType == _Network::RELIABLE ? "true" : "false") << ",\n";
+	Stream << "\t\"threaded\": " << (Settings.Threaded ? "true" : "false") << ",\n";
+	Stream << "\t\"duration\": " << Results.Duration << ",\n";
+	Stream << "\t\"packets_sent\": " << Results.PacketsSent << ",\n";
+	Stream << "\t\"packets_received\": " << Results.PacketsReceived << ",\n";
+	Stream << "\t\"bytes_received\": " << Results.BytesReceived << ",\n";
+	Stream << "\t\"packets_per_second\": " << Results.PacketsPerSecond << ",\n";
+	Stream << "\t\"bytes_per_second\": " << Results.BytesPerSecond << ",\n";
+	Stream << "\t\"broadcast_ns_per_packet\": " << Results.BroadcastTime * 1e9 << ",\n";
+	Stream << "\t\"event_ns_per_packet\": " << Results.EventTime * 1e9 << ",\n";
+	Stream << "\t\"latency_mean_ms\": " << Results.LatencyMean * 1e3 << ",\n";
+	Stream << "\t\"latency_p50_ms\": " << Results.LatencyP50 * 1e3 << ",\n";
+	Stream << "\t\"latency_p99_ms\": " << Results.LatencyP99 * 1e3 << ",\n";
+	Stream << "\t\"latency_max_ms\": " << Results.LatencyMax * 1e3 << ",\n";
+	Stream << "\t\"server_sent_speed\": " << Results.ServerSentSpeed << ",\n";
+	Stream << "\t\"server_receive_speed\": " << Results.ServerReceiveSpeed << ",\n";
+	Stream << "\t\"average_rtt_ms\": " << Results.AverageRTT << ",\n";
+	Stream << "\t\"packets_lost\": " << Results.PacketsLost << "\n";
+	Stream << "}\n";
+}
+
+}
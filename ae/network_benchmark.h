@@ -0,0 +1,139 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ae/network.h>
+#include <ostream>
+#include <vector>
+#include <cstdint>
+
+namespace ae {
+
+// Benchmark settings
+struct _NetworkBenchmarkSettings {
+	_NetworkBenchmarkSettings() :
+		Clients(16),
+		Port(0),
+		PacketSize(128),
+		SendRate(60.0),
+		WarmupTime(1.0),
+		Duration(5.0),
+		ConnectTimeout(5.0),
+		SendType(_Network::UNSEQUENCED),
+		Threaded(false) { }
+
+	// Number of _ClientNetworks connecting to the server on localhost
+	int Clients;
+
+	// Server port, 0 picks a free one
+	uint16_t Port;
+
+	// Bytes per packet, at least 8 for the timestamp
+	std::size_t PacketSize;
+
+	// Packets per second broadcast by the server and sent by each client
+	double SendRate;
+
+	// Seconds to run before and during measurement
+	double WarmupTime;
+	double Duration;
+	double ConnectTimeout;
+
+	_Network::SendType SendType;
+
+	// Service the server on its network thread
+	bool Threaded;
+};
+
+// Benchmark results, times are in seconds unless noted
+struct _NetworkBenchmarkResults {
+	_NetworkBenchmarkResults() :
+		Duration(0.0),
+		PacketsSent(0),
+		PacketsReceived(0),
+		BytesReceived(0),
+		PacketsPerSecond(0.0),
+		BytesPerSecond(0.0),
+		BroadcastTime(0.0),
+		EventTime(0.0),
+		LatencyMean(0.0),
+		LatencyP50(0.0),
+		LatencyP99(0.0),
+		LatencyMax(0.0),
+		ServerSentSpeed(0.0),
+		ServerReceiveSpeed(0.0),
+		AverageRTT(0.0),
+		PacketsLost(0) { }
+
+	double Duration;
+
+	// Throughput for packets received by server and clients
+	uint64_t PacketsSent;
+	uint64_t PacketsReceived;
+	uint64_t BytesReceived;
+	double PacketsPerSecond;
+	double BytesPerSecond;
+
+	// CPU time per packet of BroadcastPacket, and per event of server Update and event handling
+	double BroadcastTime;
+	double EventTime;
+
+	// Time from sending a packet to handling its event
+	double LatencyMean;
+	double LatencyP50;
+	double LatencyP99;
+	double LatencyMax;
+
+	// Bytes per second reported by the server
+	double ServerSentSpeed;
+	double ServerReceiveSpeed;
+
+	// Averaged over clients, RTT is in milliseconds
+	double AverageRTT;
+	uint32_t PacketsLost;
+};
+
+// Drives a _ServerNetwork with synthetic clients over loopback UDP. _Network::InitializeSystem must be called first.
+class _NetworkBenchmark {
+
+	public:
+
+		_NetworkBenchmark(const _NetworkBenchmarkSettings &Settings) : Settings(Settings) { }
+
+		const _NetworkBenchmarkResults &Run();
+		const _NetworkBenchmarkResults &GetResults() const { return Results; }
+
+		// Write settings and results as a json object
+		void WriteJSON(std::ostream &Stream) const;
+
+	private:
+
+		void AddLatency(_Buffer &Buffer, double Now);
+		static double GetPercentile(const std::vector<double> &Sorted, double Percentile);
+
+		_NetworkBenchmarkSettings Settings;
+		_NetworkBenchmarkResults Results;
+		std::vector<double> Latencies;
+		double StartTime;
+
+};
+
+}
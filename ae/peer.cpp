@@ -18,6 +18,7 @@
 * 3. This notice may not be removed or altered from any source distribution.
 *******************************************************************************/
 #include <ae/peer.h>
+#include <ae/buffer_pool.h>
 #include <enet/enet.h>
 
 namespace ae {
@@ -25,13 +26,20 @@ namespace ae {
 // Constructor
 _Peer::_Peer(_ENetPeer *ENetPeer) :
 	ENetPeer(ENetPeer),
+	Loopback(nullptr),
 	Object(nullptr),
 	AccountID(0),
+	ConnectID(ENetPeer ? ENetPeer->connectID : 0),
 	LastAck(0) {
 }
 
 // Destructor
 _Peer::~_Peer() {
+	for(auto &Update : ScheduledUpdates)
+		BufferPool.Release(Update.Data);
+	for(auto &Batch : MessageBatches)
+		BufferPool.Release(Batch.Data);
+
 	if(ENetPeer)
 		enet_peer_reset(ENetPeer);
 }
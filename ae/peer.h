@@ -20,6 +20,7 @@
 #pragma once
 
 // Libraries
+#include <vector>
 #include <cstdint>
 
 // Forward Declarations
@@ -28,6 +29,67 @@ class _Object;
 
 namespace ae {
 
+// Forward Declarations
+class _Buffer;
+struct _LoopbackConnection;
+
+// Network stats for a peer, kept by _ServerNetwork
+struct _PeerStats {
+	_PeerStats() :
+		RTT(0),
+		PacketLoss(0.0f),
+		QueuedBytes(0),
+		SentSpeed(0.0),
+		ReceiveSpeed(0.0),
+		SentData(0),
+		ReceivedData(0),
+		SecondSentData(0),
+		SecondReceivedData(0),
+		SendRate(0.0),
+		SendBudget(0.0),
+		RateTime(0.0),
+		UpdatesSent(0),
+		UpdatesDropped(0) { }
+
+	// Round trip time in milliseconds and packet loss from 0 to 1
+	uint32_t RTT;
+	float PacketLoss;
+
+	// Reliable bytes sent but not acknowledged
+	uint32_t QueuedBytes;
+
+	// Bytes per second, updated once a second
+	double SentSpeed;
+	double ReceiveSpeed;
+
+	// Byte totals
+	uint64_t SentData;
+	uint64_t ReceivedData;
+	uint32_t SecondSentData;
+	uint32_t SecondReceivedData;
+
+	// Send scheduler rate in bytes per second and bytes left to send
+	double SendRate;
+	double SendBudget;
+	double RateTime;
+	uint32_t UpdatesSent;
+	uint32_t UpdatesDropped;
+};
+
+// Unreliable update waiting for the send scheduler
+struct _ScheduledUpdate {
+	_Buffer *Data;
+	float Priority;
+	uint8_t Channel;
+};
+
+// Small messages waiting to be sent as one packet
+struct _MessageBatch {
+	_Buffer *Data;
+	int Type;
+	uint8_t Channel;
+};
+
 // Peer
 class _Peer {
 
@@ -37,11 +99,18 @@ class _Peer {
 		~_Peer();
 
 		_ENetPeer *ENetPeer;
+		_LoopbackConnection *Loopback;
 		_Object *Object;
 		uint32_t AccountID;
 		uint32_t CharacterID;
+		uint32_t ConnectID;
 		uint16_t LastAck;
 
+		// Stats, updated when sending to a const peer
+		mutable _PeerStats Stats;
+		std::vector<_ScheduledUpdate> ScheduledUpdates;
+		std::vector<_MessageBatch> MessageBatches;
+
 };
 
 }
@@ -43,38 +43,14 @@ _RigidBody::_RigidBody(const glm::vec2 &Position, const glm::vec2 &Velocity, con
 	Acceleration(Acceleration) {
 }
 
-// Integrate
+// Integrate with RK4, which is exact for constant acceleration
 void _RigidBody::Update(float DeltaTime) {
 	if(InverseMass <= 0.0f)
 		return;
 
-	// RK4 increments
-	_RigidBody A, B, C, D;
-	RungeKutta4Evaluate(_RigidBody(glm::vec2(0, 0), glm::vec2(0, 0), glm::vec2(0, 0)), 0.0f, A);
-	RungeKutta4Evaluate(A, DeltaTime * 0.5f, B);
-	RungeKutta4Evaluate(B, DeltaTime * 0.5f, C);
-	RungeKutta4Evaluate(C, DeltaTime, D);
-
-	// Calculate weighted sum
-	glm::vec2 PositionChange = (A.Position + (B.Position + C.Position) * 2.0f + D.Position) * (1.0f / 6.0f);
-	glm::vec2 VelocityChange = (A.Velocity + (B.Velocity + C.Velocity) * 2.0f + D.Velocity) * (1.0f / 6.0f);
-
-	// Update physics state
 	LastPosition = Position;
-	Position = Position + PositionChange * DeltaTime;
-	Velocity = Velocity + VelocityChange * DeltaTime;
-}
-
-// Evaluate increments
-void _RigidBody::RungeKutta4Evaluate(const _RigidBody &Derivative, float DeltaTime, _RigidBody &Output) {
-
-	_RigidBody NewState;
-	NewState.Position = Position + Derivative.Position * DeltaTime;
-	NewState.Velocity = Velocity + Derivative.Velocity * DeltaTime;
-
-	// Set derivative
-	Output.Position = NewState.Velocity;
-	Output.Velocity = Acceleration;
+	Position = Position + (Velocity + Acceleration * (DeltaTime * 0.5f)) * DeltaTime;
+	Velocity = Velocity + Acceleration * DeltaTime;
 }
 
 // Get AABB of shape from position
@@ -98,4 +74,145 @@ glm::vec4 _Shape::GetAABB(const glm::vec2 &Position) {
 	}
 }
 
+// Add a body and return its index
+std::size_t _RigidBodySystem::Add(const _RigidBody &Body) {
+	LastPositionX.push_back(0.0f);
+	LastPositionY.push_back(0.0f);
+	PositionX.push_back(0.0f);
+	PositionY.push_back(0.0f);
+	VelocityX.push_back(0.0f);
+	VelocityY.push_back(0.0f);
+	AccelerationX.push_back(0.0f);
+	AccelerationY.push_back(0.0f);
+	InverseMass.push_back(0.0f);
+
+	std::size_t Index = GetCount() - 1;
+	Set(Index, Body);
+
+	return Index;
+}
+
+// Remove a body by moving the last one into its place
+void _RigidBodySystem::Remove(std::size_t Index) {
+	std::size_t Last = GetCount() - 1;
+	if(Index != Last) {
+		LastPositionX[Index] = LastPositionX[Last];
+		LastPositionY[Index] = LastPositionY[Last];
+		PositionX[Index] = PositionX[Last];
+		PositionY[Index] = PositionY[Last];
+		VelocityX[Index] = VelocityX[Last];
+		VelocityY[Index] = VelocityY[Last];
+		AccelerationX[Index] = AccelerationX[Last];
+		AccelerationY[Index] = AccelerationY[Last];
+		InverseMass[Index] = InverseMass[Last];
+	}
+
+	LastPositionX.pop_back();
+	LastPositionY.pop_back();
+	PositionX.pop_back();
+	PositionY.pop_back();
+	VelocityX.pop_back();
+	VelocityY.pop_back();
+	AccelerationX.pop_back();
+	AccelerationY.pop_back();
+	InverseMass.pop_back();
+}
+
+// Remove all bodies
+void _RigidBodySystem::Clear() {
+	LastPositionX.clear();
+	LastPositionY.clear();
+	PositionX.clear();
+	PositionY.clear();
+	VelocityX.clear();
+	VelocityY.clear();
+	AccelerationX.clear();
+	AccelerationY.clear();
+	InverseMass.clear();
+}
+
+// Copy state to a body
+void _RigidBodySystem::Get(std::size_t Index, _RigidBody &Body) const {
+	Body.LastPosition = glm::vec2(LastPositionX[Index], LastPositionY[Index]);
+	Body.Position = glm::vec2(PositionX[Index], PositionY[Index]);
+	Body.Velocity = glm::vec2(VelocityX[Index], VelocityY[Index]);
+	Body.Acceleration = glm::vec2(AccelerationX[Index], AccelerationY[Index]);
+	Body.InverseMass = InverseMass[Index];
+}
+
+// Copy state from a body
+void _RigidBodySystem::Set(std::size_t Index, const _RigidBody &Body) {
+	LastPositionX[Index] = Body.LastPosition.x;
+	LastPositionY[Index] = Body.LastPosition.y;
+	PositionX[Index] = Body.Position.x;
+	PositionY[Index] = Body.Position.y;
+	VelocityX[Index] = Body.Velocity.x;
+	VelocityY[Index] = Body.Velocity.y;
+	AccelerationX[Index] = Body.Acceleration.x;
+	AccelerationY[Index] = Body.Acceleration.y;
+	InverseMass[Index] = Body.InverseMass;
+}
+
+// Velocity at the end of the step moves the position
+static void IntegrateSemiImplicitEuler(std::size_t Count, float DeltaTime, float *__restrict LastX, float *__restrict LastY, float *__restrict X, float *__restrict Y, float *__restrict VX, float *__restrict VY, const float *__restrict AX, const float *__restrict AY, const float *__restrict Mass) {
+	for(std::size_t i = 0; i < Count; i++) {
+		float Time = Mass[i] > 0.0f ? DeltaTime : 0.0f;
+		float PX = X[i];
+		float PY = Y[i];
+		LastX[i] = PX;
+		LastY[i] = PY;
+		VX[i] += AX[i] * Time;
+		VY[i] += AY[i] * Time;
+		X[i] = PX + VX[i] * Time;
+		Y[i] = PY + VY[i] * Time;
+	}
+}
+
+// RK4 is exact for constant acceleration, so it reduces to the closed form
+static void IntegrateConstantAcceleration(std::size_t Count, float DeltaTime, float *__restrict LastX, float *__restrict LastY, float *__restrict X, float *__restrict Y, float *__restrict VX, float *__restrict VY, const float *__restrict AX, const float *__restrict AY, const float *__restrict Mass) {
+	float HalfTime = DeltaTime * 0.5f;
+	for(std::size_t i = 0; i < Count; i++) {
+		float Time = Mass[i] > 0.0f ? DeltaTime : 0.0f;
+		float PX = X[i];
+		float PY = Y[i];
+		LastX[i] = PX;
+		LastY[i] = PY;
+		X[i] = PX + (VX[i] + AX[i] * HalfTime) * Time;
+		Y[i] = PY + (VY[i] + AY[i] * HalfTime) * Time;
+		VX[i] += AX[i] * Time;
+		VY[i] += AY[i] * Time;
+	}
+}
+
+// Position Verlet, velocity is the distance moved over the step
+static void IntegrateVerlet(std::size_t Count, float DeltaTime, float *__restrict LastX, float *__restrict LastY, float *__restrict X, float *__restrict Y, float *__restrict VX, float *__restrict VY, const float *__restrict AX, const float *__restrict AY, const float *__restrict Mass) {
+	float TimeSquared = DeltaTime * DeltaTime;
+	float InverseTime = 1.0f / DeltaTime;
+	for(std::size_t i = 0; i < Count; i++) {
+		float Scale = Mass[i] > 0.0f ? 1.0f : 0.0f;
+		float PX = X[i];
+		float PY = Y[i];
+		float NewX = PX + (PX - LastX[i] + AX[i] * TimeSquared) * Scale;
+		float NewY = PY + (PY - LastY[i] + AY[i] * TimeSquared) * Scale;
+		LastX[i] = PX;
+		LastY[i] = PY;
+		X[i] = NewX;
+		Y[i] = NewY;
+		VX[i] += ((NewX - PX) * InverseTime - VX[i]) * Scale;
+		VY[i] += ((NewY - PY) * InverseTime - VY[i]) * Scale;
+	}
+}
+
+// Integrate all bodies. Static bodies get a zero time step so the loops stay branch free and vectorize.
+void _RigidBodySystem::Update(float DeltaTime) {
+	if(Type == Integrator::SEMI_IMPLICIT_EULER)
+		IntegrateSemiImplicitEuler(GetCount(), DeltaTime, LastPositionX.data(), LastPositionY.data(), PositionX.data(), PositionY.data(), VelocityX.data(), VelocityY.data(), AccelerationX.data(), AccelerationY.data(), InverseMass.data());
+	else if(Type == Integrator::VERLET) {
+		if(DeltaTime > 0.0f)
+			IntegrateVerlet(GetCount(), DeltaTime, LastPositionX.data(), LastPositionY.data(), PositionX.data(), PositionY.data(), VelocityX.data(), VelocityY.data(), AccelerationX.data(), AccelerationY.data(), InverseMass.data());
+	}
+	else
+		IntegrateConstantAcceleration(GetCount(), DeltaTime, LastPositionX.data(), LastPositionY.data(), PositionX.data(), PositionY.data(), VelocityX.data(), VelocityY.data(), AccelerationX.data(), AccelerationY.data(), InverseMass.data());
+}
+
 }
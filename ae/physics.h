@@ -22,6 +22,8 @@
 // Libraries
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
+#include <vector>
+#include <cstddef>
 
 namespace ae {
 
@@ -75,9 +77,45 @@ class _RigidBody {
 		int CollisionGroup;
 		bool CollisionResponse;
 
-	private:
+};
+
+// Rigid body state stored as arrays and integrated in one pass
+class _RigidBodySystem {
+
+	public:
+
+		// VERLET is position Verlet, it moves bodies by Position - LastPosition and only writes Velocity.
+		// Set LastPosition to Position - (Velocity - Acceleration * DeltaTime / 2) * DeltaTime to start a body moving.
+		enum class Integrator {
+			RK4,
+			SEMI_IMPLICIT_EULER,
+			VERLET,
+		};
+
+		_RigidBodySystem(Integrator Type=Integrator::RK4) : Type(Type) { }
 
-		void RungeKutta4Evaluate(const _RigidBody &Derivative, float DeltaTime, _RigidBody &Output);
+		// Bodies are addressed by index. Remove moves the last body into Index.
+		std::size_t Add(const _RigidBody &Body);
+		void Remove(std::size_t Index);
+		void Clear();
+		std::size_t GetCount() const { return PositionX.size(); }
+
+		// Copy state to and from a body
+		void Get(std::size_t Index, _RigidBody &Body) const;
+		void Set(std::size_t Index, const _RigidBody &Body);
+
+		// Integrate all bodies, static bodies don't move
+		void Update(float DeltaTime);
+
+		// Attributes
+		Integrator Type;
+
+		// State
+		std::vector<float> LastPositionX, LastPositionY;
+		std::vector<float> PositionX, PositionY;
+		std::vector<float> VelocityX, VelocityY;
+		std::vector<float> AccelerationX, AccelerationY;
+		std::vector<float> InverseMass;
 
 };
 
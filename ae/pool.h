@@ -0,0 +1,155 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <vector>
+#include <new>
+#include <cstddef>
+
+namespace ae {
+
+// Pool usage
+struct _PoolStats {
+	_PoolStats() : Live(0), Peak(0), BytesReserved(0), Chunks(0) { }
+
+	std::size_t Live;
+	std::size_t Peak;
+	std::size_t BytesReserved;
+	std::size_t Chunks;
+};
+
+// Fixed-size block allocator for objects of one type
+template<class T> class _Pool {
+
+	public:
+
+		_Pool(std::size_t ChunkBlocks=64, std::size_t MaxChunkBlocks=4096);
+		~_Pool();
+
+		void *Allocate();
+		void Free(void *Block);
+
+		// Growth policy, each new chunk doubles in size up to MaxChunkBlocks
+		void SetGrowth(std::size_t ChunkBlocks, std::size_t MaxChunkBlocks) { this->ChunkBlocks = ChunkBlocks ? ChunkBlocks : 1; this->MaxChunkBlocks = MaxChunkBlocks; }
+		void Reserve(std::size_t Blocks);
+
+		const _PoolStats &GetStats() const { return Stats; }
+
+	private:
+
+		// Free blocks store the next free block in place
+		struct _FreeBlock {
+			_FreeBlock *Next;
+		};
+
+		static const std::size_t BLOCK_ALIGN = alignof(T) > alignof(_FreeBlock) ? alignof(T) : alignof(_FreeBlock);
+		static const std::size_t BLOCK_SIZE = ((sizeof(T) > sizeof(_FreeBlock) ? sizeof(T) : sizeof(_FreeBlock)) + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+		static_assert(BLOCK_ALIGN <= alignof(std::max_align_t), "_Pool doesn't support over-aligned types");
+
+		_Pool(const _Pool &) = delete;
+		_Pool &operator=(const _Pool &) = delete;
+
+		void AddChunk(std::size_t Blocks);
+
+		std::vector<void *> Chunks;
+		_FreeBlock *FreeList;
+		std::size_t ChunkBlocks;
+		std::size_t MaxChunkBlocks;
+		_PoolStats Stats;
+
+};
+
+// Constructor
+template <class T>
+_Pool<T>::_Pool(std::size_t ChunkBlocks, std::size_t MaxChunkBlocks) :
+	FreeList(nullptr),
+	ChunkBlocks(ChunkBlocks ? ChunkBlocks : 1),
+	MaxChunkBlocks(MaxChunkBlocks) {
+
+}
+
+// Destructor
+template <class T>
+_Pool<T>::~_Pool() {
+
+	for(auto &Chunk : Chunks)
+		::operator delete(Chunk);
+}
+
+// Get a free block, adding a chunk if needed
+template <class T>
+void *_Pool<T>::Allocate() {
+	if(!FreeList) {
+		AddChunk(ChunkBlocks);
+		if(ChunkBlocks < MaxChunkBlocks)
+			ChunkBlocks = ChunkBlocks * 2 < MaxChunkBlocks ? ChunkBlocks * 2 : MaxChunkBlocks;
+	}
+
+	_FreeBlock *Block = FreeList;
+	FreeList = Block->Next;
+
+	// Update stats
+	Stats.Live++;
+	if(Stats.Live > Stats.Peak)
+		Stats.Peak = Stats.Live;
+
+	return Block;
+}
+
+// Return a block to the free list
+template <class T>
+void _Pool<T>::Free(void *Block) {
+	if(!Block)
+		return;
+
+	_FreeBlock *FreeBlock = (_FreeBlock *)Block;
+	FreeBlock->Next = FreeList;
+	FreeList = FreeBlock;
+
+	Stats.Live--;
+}
+
+// Make sure at least a number of blocks are available without growing
+template <class T>
+void _Pool<T>::Reserve(std::size_t Blocks) {
+	std::size_t Available = Stats.BytesReserved / BLOCK_SIZE - Stats.Live;
+	if(Blocks > Available)
+		AddChunk(Blocks - Available);
+}
+
+// Allocate a chunk and thread its blocks onto the free list
+template <class T>
+void _Pool<T>::AddChunk(std::size_t Blocks) {
+	char *Chunk = (char *)::operator new(Blocks * BLOCK_SIZE);
+	Chunks.push_back(Chunk);
+
+	// Link blocks in address order
+	for(std::size_t i = Blocks; i > 0; i--) {
+		_FreeBlock *Block = (_FreeBlock *)(Chunk + (i - 1) * BLOCK_SIZE);
+		Block->Next = FreeList;
+		FreeList = Block;
+	}
+
+	Stats.BytesReserved += Blocks * BLOCK_SIZE;
+	Stats.Chunks++;
+}
+
+}
@@ -0,0 +1,275 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ae/manager.h>
+#include <ae/network.h>
+#include <ae/buffer.h>
+#include <ae/peer.h>
+#include <ae/type.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace ae {
+
+// What a peer knows about one object
+struct _ReplicationState {
+	_ReplicationState() : Generation(0), Priority(0.0f), LastSent(0.0), Tick(0), CreateSequence(0), DeleteSequence(0), CreateMask(0), Sent(false), Created(false), Deleted(false) { }
+
+	uint32_t Generation;
+
+	// Relevance accumulated since the object was last sent
+	float Priority;
+	double LastSent;
+	uint32_t Tick;
+
+	// Sequence of the last packet with a create or delete, resent until the peer acks it
+	uint16_t CreateSequence;
+	uint16_t DeleteSequence;
+
+	// Bit n is set when packet CreateSequence - n carried the create
+	uint32_t CreateMask;
+	bool Sent;
+	bool Created;
+	bool Deleted;
+};
+
+// Picks which objects from a _Manager to send to each peer within a byte budget.
+// Packets are acked through _Peer::LastAck. Until a create or delete is acked it is sent again.
+// A create only counts as acked when the acked packet carried it, since objects can be skipped by the budget.
+template<class T> class _Replication {
+
+	public:
+
+		_Replication(_Manager<T> &Manager) : Manager(Manager), Tick(0) { }
+
+		// Write an update for one peer. Relevance(const T *, const _Peer *) returns how important the object is
+		// to the peer this tick, 0 or less means out of scope. Write(_Buffer &, const T *, bool Create) writes object state.
+		// Sequence must not be 0 and is compared with _Peer::LastAck.
+		template<typename R, typename W> std::size_t Replicate(_Peer *Peer, _Buffer &Packet, uint16_t Sequence, double Time, std::size_t Budget, R Relevance, W Write);
+
+		// Read an update. OnDelete(NetworkIDType) and OnUpdate(NetworkIDType, bool Create, _Buffer &) are called for each entry.
+		template<typename D, typename U> static void Read(_Buffer &Packet, D OnDelete, U OnUpdate);
+
+		// Peers
+		void RemovePeer(const _Peer *Peer) { Peers.erase(Peer); }
+		void Clear() { Peers.clear(); }
+		bool HasObject(const _Peer *Peer, NetworkIDType ID) const;
+
+	private:
+
+		// Object ranked for sending
+		struct _Candidate {
+			T *Object;
+			_ReplicationState *State;
+		};
+
+		typedef std::unordered_map<NetworkIDType, _ReplicationState> _PeerStates;
+
+		static bool IsAcked(const _Peer *Peer, uint16_t Sequence) { return Peer->LastAck && (Peer->LastAck == Sequence || _Network::MoreRecentAck(Sequence, Peer->LastAck, UINT16_MAX)); }
+		static bool IsCreateAcked(const _Peer *Peer, const _ReplicationState &State);
+
+		_Manager<T> &Manager;
+		std::unordered_map<const _Peer *, _PeerStates> Peers;
+		std::vector<_Candidate> Candidates;
+		std::vector<NetworkIDType> Deletes;
+		_Buffer Entry;
+		_Buffer Body;
+		uint32_t Tick;
+
+};
+
+// Rank relevant objects and fill the packet up to the budget, returns the number of objects written
+template<class T> template<typename R, typename W>
+std::size_t _Replication<T>::Replicate(_Peer *Peer, _Buffer &Packet, uint16_t Sequence, double Time, std::size_t Budget, R Relevance, W Write) {
+	_PeerStates &States = Peers[Peer];
+	Candidates.clear();
+	Deletes.clear();
+	Body.Reset();
+	Tick++;
+
+	// Accumulate priority for relevant objects
+	for(auto &Object : Manager.Objects) {
+		if(Object->Deleted)
+			continue;
+
+		float ObjectRelevance = Relevance((const T *)Object, (const _Peer *)Peer);
+		auto Iterator = States.find(Object->NetworkID);
+		if(ObjectRelevance <= 0.0f && Iterator == States.end())
+			continue;
+
+		// Reset state when the id has been reused
+		_ReplicationState &State = Iterator == States.end() ? States[Object->NetworkID] : Iterator->second;
+		uint32_t Generation = Manager.GetHandle(Object).Generation;
+		if(ObjectRelevance > 0.0f && (State.Generation != Generation || State.Deleted)) {
+			State = _ReplicationState();
+			State.Generation = Generation;
+		}
+
+		if(State.Generation != Generation || ObjectRelevance <= 0.0f)
+			continue;
+
+		State.Tick = Tick;
+		State.Priority += ObjectRelevance;
+		if(State.Sent && !State.Created && IsCreateAcked(Peer, State))
+			State.Created = true;
+
+		Candidates.push_back({ Object, &State });
+	}
+
+	// Objects that left scope or were deleted
+	for(auto Iterator = States.begin(); Iterator != States.end(); ) {
+		_ReplicationState &State = Iterator->second;
+		if(State.Tick != Tick && !State.Deleted) {
+			State.Deleted = true;
+			State.DeleteSequence = 0;
+		}
+
+		// Forget objects the peer never got or has acked the delete for
+		if(State.Deleted && (!State.Sent || (State.DeleteSequence && IsAcked(Peer, State.DeleteSequence)))) {
+			Iterator = States.erase(Iterator);
+			continue;
+		}
+
+		if(State.Deleted) {
+			State.DeleteSequence = Sequence;
+			Deletes.push_back(Iterator->first);
+		}
+
+		++Iterator;
+	}
+
+	// Write deletes
+	std::size_t Start = Packet.GetCurrentSize();
+	Packet.WriteVarInt(Deletes.size());
+	for(const auto &ID : Deletes)
+		Packet.WriteVarInt(ID);
+
+	// Most important first
+	std::stable_sort(Candidates.begin(), Candidates.end(), [](const _Candidate &A, const _Candidate &B) {
+		return A.State->Priority > B.State->Priority;
+	});
+
+	// Fill budget, skipping objects that don't fit
+	std::size_t Used = Packet.GetCurrentSize() - Start + 3;
+	std::size_t Count = 0;
+	for(auto &Candidate : Candidates) {
+		_ReplicationState &State = *Candidate.State;
+		bool Create = !State.Created;
+
+		Entry.Reset();
+		Write(Entry, (const T *)Candidate.Object, Create);
+		std::size_t Size = Entry.GetCurrentSize();
+		if(Used + Size + 7 > Budget)
+			continue;
+
+		std::size_t BodyStart = Body.GetCurrentSize();
+		Body.WriteVarInt(Candidate.Object->NetworkID);
+		Body.Write<uint8_t>(Create);
+		Body.WriteVarInt(Size);
+		Body.WriteData(Entry.GetData(), Size);
+		Used += Body.GetCurrentSize() - BodyStart;
+
+		State.Priority = 0.0f;
+		State.LastSent = Time;
+		if(Create) {
+			uint16_t Age = (uint16_t)(Sequence - State.CreateSequence);
+			State.CreateMask = State.Sent && Age < 32 ? State.CreateMask << Age : 0;
+			State.CreateMask |= 1;
+			State.Sent = true;
+			State.CreateSequence = Sequence;
+		}
+
+		Count++;
+	}
+
+	// Write updates
+	Packet.WriteVarInt(Count);
+	Packet.WriteData(Body.GetData(), Body.GetCurrentSize());
+
+	return Count;
+}
+
+// Determine if the last acked packet carried the create for an object
+template<class T>
+bool _Replication<T>::IsCreateAcked(const _Peer *Peer, const _ReplicationState &State) {
+	if(!Peer->LastAck)
+		return false;
+
+	// Acks newer than the last create wrap to a large age
+	uint16_t Age = (uint16_t)(State.CreateSequence - Peer->LastAck);
+	return Age < 32 && (State.CreateMask >> Age) & 1;
+}
+
+// Read an update written by Replicate
+template<class T> template<typename D, typename U>
+void _Replication<T>::Read(_Buffer &Packet, D OnDelete, U OnUpdate) {
+
+	// Deletes, each id takes at least one byte
+	uint64_t DeleteCount = Packet.ReadVarInt();
+	if(Packet.HasError() || DeleteCount > Packet.GetRemainingSize())
+		return;
+
+	for(uint64_t i = 0; i < DeleteCount; i++) {
+		NetworkIDType ID = (NetworkIDType)Packet.ReadVarInt();
+		if(Packet.HasError())
+			return;
+
+		OnDelete(ID);
+	}
+
+	// Updates, each entry takes at least three bytes
+	std::vector<char> Data;
+	_Buffer EntryData(0);
+	uint64_t Count = Packet.ReadVarInt();
+	if(Packet.HasError() || Count > Packet.GetRemainingSize() / 3)
+		return;
+
+	for(uint64_t i = 0; i < Count; i++) {
+		NetworkIDType ID = (NetworkIDType)Packet.ReadVarInt();
+		bool Create = Packet.Read<uint8_t>();
+		uint64_t Size = Packet.ReadVarInt();
+		if(Packet.HasError() || Size > Packet.GetRemainingSize())
+			return;
+
+		Data.resize((std::size_t)Size);
+		if(!Packet.ReadData(Data.data(), (std::size_t)Size))
+			return;
+
+		EntryData.Adopt(Data.data(), (std::size_t)Size, nullptr, nullptr);
+		OnUpdate(ID, Create, EntryData);
+	}
+}
+
+// Determine if a peer has been sent an object
+template<class T>
+bool _Replication<T>::HasObject(const _Peer *Peer, NetworkIDType ID) const {
+	auto PeerIterator = Peers.find(Peer);
+	if(PeerIterator == Peers.end())
+		return false;
+
+	auto Iterator = PeerIterator->second.find(ID);
+	return Iterator != PeerIterator->second.end() && Iterator->second.Sent && !Iterator->second.Deleted;
+}
+
+}
@@ -20,13 +20,44 @@
 #include <ae/servernetwork.h>
 #include <ae/peer.h>
 #include <ae/buffer.h>
+#include <ae/buffer_pool.h>
+#include <ae/loopback.h>
+#include <ae/spsc_queue.h>
 #include <enet/enet.h>
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+#endif
 #include <stdexcept>
 
 namespace ae {
 
 // Constructor
-_ServerNetwork::_ServerNetwork(std::size_t MaxPeers, uint16_t Port) {
+_ServerNetwork::_ServerNetwork(std::size_t MaxPeers, uint16_t Port) :
+	MinSendRate(2048.0),
+	MaxSendRate(64.0 * 1024.0),
+	CongestionQueuedBytes(32 * 1024),
+	CongestionPacketLoss(0.05f),
+	LastUpdatesTime(0.0),
+	MaxBatchSize(1200),
+	PingRate(2.0),
+	PingBurst(4.0),
+	PingCleanTime(0.0),
+	LoopbackHub(nullptr),
+	LoopbackSentData(0),
+	LoopbackReceivedData(0),
+	Thread(nullptr),
+	ThreadDone(false),
+	ServiceTimeout(1),
+	InboundEvents(nullptr),
+	Commands(nullptr),
+	ThreadSentData(0),
+	ThreadReceivedData(0),
+	ThreadPeerStats(nullptr) {
+
 	ENetAddress Address;
 	Address.host = ENET_HOST_ANY;
 	Address.port = Port;
@@ -37,7 +68,197 @@ _ServerNetwork::_ServerNetwork(std::size_t MaxPeers, uint16_t Port) {
 
 // Destructor
 _ServerNetwork::~_ServerNetwork() {
+	StopThread();
+	DetachLoopback();
 	ClearPeers();
+
+	// Free packets the game thread never received
+	if(InboundEvents) {
+		ENetEvent EEvent;
+		while(InboundEvents->Pop(EEvent))
+			DiscardENetEvent(EEvent);
+	}
+
+	delete InboundEvents;
+	delete Commands;
+	delete[] ThreadPeerStats;
+}
+
+// Start servicing enet on a separate thread. Events are passed to Update and sends are passed back through queues.
+void _ServerNetwork::StartThread(uint32_t ServiceTimeout) {
+	if(Thread || !Connection)
+		return;
+
+	if(!InboundEvents) {
+		InboundEvents = new _SPSCQueue<ENetEvent>(4096);
+		Commands = new _SPSCQueue<_Command>(16384);
+		ThreadPeerStats = new _ThreadPeerStats[Connection->peerCount];
+	}
+
+	this->ServiceTimeout = ServiceTimeout;
+	ThreadDone = false;
+	Thread = new std::thread(RunThread, this);
+}
+
+// Stop network thread and run any commands it didn't get to
+void _ServerNetwork::StopThread() {
+	if(!Thread)
+		return;
+
+	ThreadDone = true;
+	Thread->join();
+	delete Thread;
+	Thread = nullptr;
+
+	_Command Command;
+	while(Commands->Pop(Command))
+		RunCommand(Command);
+
+	for(const auto &OverflowCommand : OverflowCommands)
+		RunCommand(OverflowCommand);
+	OverflowCommands.clear();
+}
+
+// Network thread loop
+void _ServerNetwork::RunThread(_ServerNetwork *ServerNetwork) {
+	while(!ServerNetwork->ThreadDone) {
+
+		// Run commands from game thread
+		_Command Command;
+		while(ServerNetwork->Commands->Pop(Command))
+			ServerNetwork->RunCommand(Command);
+
+		// Send queued packets and wait for events
+		ENetEvent EEvent;
+		int Result = enet_host_service(ServerNetwork->Connection, &EEvent, ServerNetwork->ServiceTimeout);
+		while(Result > 0) {
+			while(!ServerNetwork->InboundEvents->Push(EEvent)) {
+				if(ServerNetwork->ThreadDone) {
+					DiscardENetEvent(EEvent);
+					break;
+				}
+
+				// Keep running commands so a game thread waiting on the command queue can get to the events
+				while(ServerNetwork->Commands->Pop(Command))
+					ServerNetwork->RunCommand(Command);
+
+				std::this_thread::yield();
+			}
+
+			Result = enet_host_check_events(ServerNetwork->Connection, &EEvent);
+		}
+
+		// Move data counters out of enet
+		ServerNetwork->ThreadSentData += ServerNetwork->Connection->totalSentData;
+		ServerNetwork->ThreadReceivedData += ServerNetwork->Connection->totalReceivedData;
+		ServerNetwork->Connection->totalSentData = 0;
+		ServerNetwork->Connection->totalReceivedData = 0;
+
+		// Copy peer stats for the game thread
+		for(std::size_t i = 0; i < ServerNetwork->Connection->peerCount; i++) {
+			const ENetPeer &ENetPeer = ServerNetwork->Connection->peers[i];
+			_ThreadPeerStats &Stats = ServerNetwork->ThreadPeerStats[i];
+			Stats.RTT.store(ENetPeer.roundTripTime, std::memory_order_relaxed);
+			Stats.PacketLoss.store(ENetPeer.packetLoss, std::memory_order_relaxed);
+			Stats.QueuedBytes.store(ENetPeer.reliableDataInTransit, std::memory_order_relaxed);
+		}
+	}
+}
+
+// Get next event from the network thread or enet
+bool _ServerNetwork::GetENetEvent(ENetEvent &EEvent) {
+	FlushCommands();
+	if(InboundEvents && InboundEvents->Pop(EEvent))
+		return true;
+
+	if(Thread)
+		return false;
+
+	return _Network::GetENetEvent(EEvent);
+}
+
+// Get and reset data counters
+void _ServerNetwork::TakeDataTotals(uint32_t &SentData, uint32_t &ReceivedData) {
+	SentData = ThreadSentData.exchange(0) + LoopbackSentData;
+	ReceivedData = ThreadReceivedData.exchange(0) + LoopbackReceivedData;
+	LoopbackSentData = 0;
+	LoopbackReceivedData = 0;
+	if(Thread)
+		return;
+
+	uint32_t ConnectionSentData;
+	uint32_t ConnectionReceivedData;
+	_Network::TakeDataTotals(ConnectionSentData, ConnectionReceivedData);
+	SentData += ConnectionSentData;
+	ReceivedData += ConnectionReceivedData;
+}
+
+// Pass a request to the network thread, keeping it in the overflow list if the queue is full
+void _ServerNetwork::QueueCommand(_Command::CommandType Type, _ENetPeer *ENetPeer, uint32_t ConnectID, ENetPacket *Packet, uint8_t Channel, int Data) {
+	_Command Command;
+	Command.Type = Type;
+	Command.ENetPeer = ENetPeer;
+	Command.ConnectID = ConnectID;
+	Command.Packet = Packet;
+	Command.Channel = Channel;
+	Command.Data = Data;
+
+	// Run directly once the thread has stopped
+	if(!Thread) {
+		RunCommand(Command);
+		return;
+	}
+
+	// Keep order behind commands that didn't fit
+	FlushCommands();
+	if(!OverflowCommands.empty() || !Commands->Push(Command))
+		OverflowCommands.push_back(Command);
+}
+
+// Move overflow commands into the queue as space frees up
+void _ServerNetwork::FlushCommands() {
+	if(OverflowCommands.empty() || !Commands)
+		return;
+
+	std::size_t Count = 0;
+	while(Count < OverflowCommands.size() && Commands->Push(OverflowCommands[Count]))
+		Count++;
+
+	OverflowCommands.erase(OverflowCommands.begin(), OverflowCommands.begin() + (std::ptrdiff_t)Count);
+}
+
+// Free an event that won't be handled
+void _ServerNetwork::DiscardENetEvent(ENetEvent &EEvent) {
+	if(EEvent.type == ENET_EVENT_TYPE_RECEIVE && EEvent.packet)
+		enet_packet_destroy(EEvent.packet);
+}
+
+// Run a request on the network thread, ignoring peers whose connection was replaced
+void _ServerNetwork::RunCommand(const _Command &Command) {
+	bool Connected = Command.ENetPeer && Command.ENetPeer->connectID == Command.ConnectID && Command.ENetPeer->state != ENET_PEER_STATE_DISCONNECTED;
+
+	switch(Command.Type) {
+		case _Command::SEND:
+			if(!Connected || enet_peer_send(Command.ENetPeer, Command.Channel, Command.Packet) != 0)
+				enet_packet_destroy(Command.Packet);
+		break;
+		case _Command::SEND_SHARED:
+			if(Connected)
+				enet_peer_send(Command.ENetPeer, Command.Channel, Command.Packet);
+		break;
+		case _Command::RELEASE:
+			if(--Command.Packet->referenceCount == 0)
+				enet_packet_destroy(Command.Packet);
+		break;
+		case _Command::DISCONNECT:
+			if(Connected)
+				enet_peer_disconnect(Command.ENetPeer, (enet_uint32)Command.Data);
+		break;
+		case _Command::RESET:
+			if(Connected)
+				enet_peer_reset(Command.ENetPeer);
+		break;
+	}
 }
 
 // Create ping socket
@@ -77,6 +298,17 @@ void _ServerNetwork::DeletePeer(_Peer *Peer) {
 	for(auto Iterator = Peers.begin(); Iterator != Peers.end(); ++Iterator) {
 		if((*Iterator) == Peer) {
 			Peers.erase(Iterator);
+			if(Peer->Loopback) {
+				Peer->Loopback->ServerPeer = nullptr;
+				Peer->Loopback->Hub->FreeConnection(Peer->Loopback);
+			}
+
+			// Let the network thread reset the enet peer
+			if(Thread && Peer->ENetPeer) {
+				QueueCommand(_Command::RESET, Peer->ENetPeer, Peer->ConnectID);
+				Peer->ENetPeer = nullptr;
+			}
+
 			delete Peer;
 			break;
 		}
@@ -87,18 +319,42 @@ void _ServerNetwork::DeletePeer(_Peer *Peer) {
 void _ServerNetwork::ClearPeers() {
 
 	// Delete peers
-	for(auto &Peer : Peers)
+	for(auto &Peer : Peers) {
+		if(Peer->Loopback) {
+			Peer->Loopback->ServerPeer = nullptr;
+			Peer->Loopback->Hub->FreeConnection(Peer->Loopback);
+		}
+
 		delete Peer;
+	}
 
 	Peers.clear();
 }
 
 // Disconnect a single peer
 void _ServerNetwork::DisconnectPeer(const _Peer *Peer, int Data) {
-	if(!Peer || !Peer->ENetPeer)
+	if(!Peer)
 		return;
 
-	enet_peer_disconnect(Peer->ENetPeer, Data);
+	// Close in-memory connection, both sides get a disconnect event
+	_LoopbackConnection *Loopback = Peer->Loopback;
+	if(Loopback) {
+		if(!Loopback->Accepted)
+			return;
+
+		Loopback->Accepted = false;
+		Loopback->Hub->SendToClient(Loopback, _NetworkEvent::DISCONNECT, nullptr, Data);
+		Loopback->Hub->SendToServer(Loopback, _NetworkEvent::DISCONNECT, nullptr, Data);
+		return;
+	}
+
+	if(!Peer->ENetPeer)
+		return;
+
+	if(Thread)
+		QueueCommand(_Command::DISCONNECT, Peer->ENetPeer, Peer->ConnectID, nullptr, 0, Data);
+	else
+		enet_peer_disconnect(Peer->ENetPeer, Data);
 }
 
 // Disconnect all peers
@@ -106,7 +362,7 @@ void _ServerNetwork::DisconnectAll(int Data) {
 
 	// Disconnect all connected peers
 	for(auto &Peer : Peers)
-		enet_peer_disconnect(Peer->ENetPeer, Data);
+		DisconnectPeer(Peer, Data);
 }
 
 // Create a _NetworkEvent from an enet event
@@ -135,32 +391,500 @@ void _ServerNetwork::HandleEvent(_NetworkEvent &Event, ENetEvent &EEvent) {
 		case _NetworkEvent::DISCONNECT:
 		break;
 		case _NetworkEvent::PACKET: {
-			Event.Data = new _Buffer((char *)EEvent.packet->data, EEvent.packet->dataLength);
-			enet_packet_destroy(EEvent.packet);
+			if(Event.Peer) {
+				Event.Peer->Stats.ReceivedData += EEvent.packet->dataLength;
+				Event.Peer->Stats.SecondReceivedData += (uint32_t)EEvent.packet->dataLength;
+			}
 		} break;
 	}
 }
 
 // Send a packet
 void _ServerNetwork::SendPacket(const _Buffer &Buffer, const _Peer *Peer, SendType Type, uint8_t Channel) {
+	_PeerStats &Stats = Peer->Stats;
+	Stats.SentData += Buffer.GetCurrentSize();
+	Stats.SecondSentData += (uint32_t)Buffer.GetCurrentSize();
+
+	// Send through in-memory connection
+	if(Peer->Loopback) {
+		if(Peer->Loopback->Accepted) {
+			LoopbackSentData += (uint32_t)Buffer.GetCurrentSize();
+			Peer->Loopback->Hub->SendToClient(Peer->Loopback, _NetworkEvent::PACKET, &Buffer, 0, Type == RELIABLE);
+		}
+
+		return;
+	}
+
 	if(!Peer->ENetPeer)
 		return;
 
 	// Create enet packet
-	ENetPacket *EPacket = enet_packet_create(Buffer.GetData(), Buffer.GetCurrentSize(), Type);
+	ENetPacket *EPacket = CreateENetPacket(Buffer, Type);
 
 	// Send packet
-	if(enet_peer_send(Peer->ENetPeer, Channel, EPacket) != 0)
-		enet_packet_destroy(EPacket);
+	SendENetPacket(Peer->ENetPeer, Peer->ConnectID, Channel, EPacket);
 }
 
-// Send a packet to all peers
-void _ServerNetwork::BroadcastPacket(const _Buffer &Buffer, _Peer *ExceptionPeer, SendType Type, uint8_t Channel) {
+// Pass packet to enet or the network thread
+void _ServerNetwork::DeliverPacket(_ENetPeer *ENetPeer, uint32_t ConnectID, uint8_t Channel, ENetPacket *Packet) {
+	if(Thread)
+		QueueCommand(_Command::SEND, ENetPeer, ConnectID, Packet, Channel);
+	else
+		_Network::DeliverPacket(ENetPeer, ConnectID, Channel, Packet);
+}
 
+// Send a packet to all peers, sharing one enet packet between them
+void _ServerNetwork::BroadcastPacket(const _Buffer &Buffer, _Peer *ExceptionPeer, SendType Type, uint8_t Channel) {
+	ENetPacket *EPacket = nullptr;
 	for(auto &Peer : Peers) {
 		if(Peer != ExceptionPeer && Peer->Object)
-			SendPacket(Buffer, Peer, Type, Channel);
+			SendSharedPacket(EPacket, Buffer, Peer, Type, Channel);
+	}
+
+	FreeSharedPacket(EPacket);
+}
+
+// Send a packet to a list of peers, sharing one enet packet between them
+void _ServerNetwork::MulticastPacket(const _Buffer &Buffer, const std::vector<_Peer *> &TargetPeers, SendType Type, uint8_t Channel) {
+	ENetPacket *EPacket = nullptr;
+	for(auto &Peer : TargetPeers)
+		SendSharedPacket(EPacket, Buffer, Peer, Type, Channel);
+
+	FreeSharedPacket(EPacket);
+}
+
+// Queue a reference counted packet to a peer, creating it on first use
+void _ServerNetwork::SendSharedPacket(ENetPacket *&EPacket, const _Buffer &Buffer, const _Peer *Peer, SendType Type, uint8_t Channel) {
+	if(!Peer)
+		return;
+
+	// Simulated links and in-memory connections send a separate copy to each peer
+	if(IsSimulating() || Peer->Loopback) {
+		SendPacket(Buffer, Peer, Type, Channel);
+		return;
+	}
+
+	if(!Peer->ENetPeer)
+		return;
+
+	_PeerStats &Stats = Peer->Stats;
+	Stats.SentData += Buffer.GetCurrentSize();
+	Stats.SecondSentData += (uint32_t)Buffer.GetCurrentSize();
+
+	// Hold a reference while the network thread sends it
+	if(!EPacket) {
+		EPacket = CreateENetPacket(Buffer, Type);
+		if(Thread)
+			EPacket->referenceCount++;
+	}
+
+	if(Thread)
+		QueueCommand(_Command::SEND_SHARED, Peer->ENetPeer, Peer->ConnectID, EPacket, Channel);
+	else
+		enet_peer_send(Peer->ENetPeer, Channel, EPacket);
+}
+
+// Destroy a shared packet if no peer took a reference to it
+void _ServerNetwork::FreeSharedPacket(ENetPacket *EPacket) {
+	if(!EPacket)
+		return;
+
+	if(Thread)
+		QueueCommand(_Command::RELEASE, nullptr, 0, EPacket);
+	else if(EPacket->referenceCount == 0)
+		enet_packet_destroy(EPacket);
+}
+
+// Accept in-memory connections from a hub
+void _ServerNetwork::AttachLoopback(_LoopbackHub *Hub) {
+	DetachLoopback();
+	LoopbackHub = Hub;
+	if(LoopbackHub)
+		LoopbackHub->SetServer(this);
+}
+
+// Stop using the hub, called by the hub when it's destroyed
+void _ServerNetwork::DetachLoopback() {
+	if(!LoopbackHub)
+		return;
+
+	for(auto &Peer : Peers) {
+		_LoopbackConnection *Loopback = Peer->Loopback;
+		if(!Loopback)
+			continue;
+
+		// Clients still connected get a disconnect
+		if(Loopback->Accepted) {
+			Loopback->Accepted = false;
+			LoopbackHub->SendToClient(Loopback, _NetworkEvent::DISCONNECT);
+		}
+
+		Loopback->ServerPeer = nullptr;
+		Peer->Loopback = nullptr;
+		LoopbackHub->FreeConnection(Loopback);
+
+		_NetworkEvent Event;
+		Event.Type = _NetworkEvent::DISCONNECT;
+		Event.Time = Time + FakeLag;
+		Event.Peer = Peer;
+		QueueEvent(Event, true);
+	}
+
+	LoopbackHub->SetServer(nullptr);
+	LoopbackHub = nullptr;
+}
+
+// Turn messages from loopback clients into network events
+void _ServerNetwork::ReceiveLoopbackEvents() {
+	if(!LoopbackHub)
+		return;
+
+	_LoopbackMessage Message;
+	while(LoopbackHub->GetServerMessage(Message)) {
+		_LoopbackConnection *Loopback = Message.Connection;
+
+		_NetworkEvent Event;
+		Event.Type = Message.Type;
+		Event.Time = Time + FakeLag;
+		Event.EventData = Message.EventData;
+		Event.Data = Message.Data;
+		Event.Peer = Loopback->ServerPeer;
+
+		bool Queue = true;
+		switch(Message.Type) {
+			case _NetworkEvent::CONNECT: {
+
+				// Ignore repeats and clients that are already gone
+				if(Loopback->Accepted || !Loopback->Client) {
+					Queue = false;
+					break;
+				}
+
+				// Create peer
+				Event.Peer = new _Peer(nullptr);
+				Event.Peer->Loopback = Loopback;
+				Loopback->ServerPeer = Event.Peer;
+				Loopback->Accepted = true;
+				Peers.push_back(Event.Peer);
+
+				LoopbackHub->SendToClient(Loopback, _NetworkEvent::CONNECT);
+			} break;
+			case _NetworkEvent::DISCONNECT:
+				Queue = Event.Peer != nullptr;
+			break;
+			case _NetworkEvent::PACKET:
+				if(!Event.Peer || !Loopback->Accepted) {
+					Queue = false;
+					break;
+				}
+
+				LoopbackReceivedData += (uint32_t)Event.Data->GetAllocatedSize();
+				Event.Peer->Stats.ReceivedData += Event.Data->GetAllocatedSize();
+				Event.Peer->Stats.SecondReceivedData += (uint32_t)Event.Data->GetAllocatedSize();
+			break;
+		}
+
+		if(Queue)
+			QueueEvent(Event, Message.Reliable);
+		else
+			BufferPool.Release(Event.Data);
+
+		LoopbackHub->FreeConnection(Loopback);
+	}
+}
+
+// Copy a packet into a peer's update queue, sent later by SendUpdates
+void _ServerNetwork::QueueUpdate(const _Buffer &Buffer, _Peer *Peer, float Priority, uint8_t Channel) {
+	if(!Peer)
+		return;
+
+	_ScheduledUpdate Update;
+	Update.Data = BufferPool.Acquire(Buffer.GetCurrentSize());
+	Update.Data->WriteData(Buffer.GetData(), Buffer.GetCurrentSize());
+	Update.Priority = Priority;
+	Update.Channel = Channel;
+	Peer->ScheduledUpdates.push_back(Update);
+}
+
+// Send queued updates by priority until each peer's budget runs out and drop the rest
+void _ServerNetwork::SendUpdates() {
+	double Elapsed = std::min(Time - LastUpdatesTime, 1.0);
+	LastUpdatesTime = Time;
+
+	for(auto &Peer : Peers) {
+		_PeerStats &Stats = Peer->Stats;
+		RefreshPeerStats(Peer);
+		AdjustSendRate(Peer);
+
+		// Refill budget, allowing a small burst
+		Stats.SendBudget = std::min(Stats.SendBudget + Stats.SendRate * Elapsed, Stats.SendRate * 0.25);
+
+		// Highest priority first
+		std::stable_sort(Peer->ScheduledUpdates.begin(), Peer->ScheduledUpdates.end(), [](const _ScheduledUpdate &A, const _ScheduledUpdate &B) {
+			return A.Priority > B.Priority;
+		});
+
+		// Budget can go negative once so large updates still get sent
+		for(auto &Update : Peer->ScheduledUpdates) {
+			if(Stats.SendBudget > 0.0) {
+				SendPacket(*Update.Data, Peer, UNSEQUENCED, Update.Channel);
+				Stats.SendBudget -= Update.Data->GetCurrentSize();
+				Stats.UpdatesSent++;
+			}
+			else
+				Stats.UpdatesDropped++;
+
+			BufferPool.Release(Update.Data);
+		}
+
+		Peer->ScheduledUpdates.clear();
+	}
+}
+
+// Get RTT, loss and queued bytes from enet
+void _ServerNetwork::RefreshPeerStats(_Peer *Peer) {
+	if(!Peer->ENetPeer || !Connection)
+		return;
+
+	_PeerStats &Stats = Peer->Stats;
+	if(Thread) {
+		const _ThreadPeerStats &ThreadStats = ThreadPeerStats[Peer->ENetPeer - Connection->peers];
+		Stats.RTT = ThreadStats.RTT.load(std::memory_order_relaxed);
+		Stats.PacketLoss = ThreadStats.PacketLoss.load(std::memory_order_relaxed) / (float)ENET_PEER_PACKET_LOSS_SCALE;
+		Stats.QueuedBytes = ThreadStats.QueuedBytes.load(std::memory_order_relaxed);
+	}
+	else {
+		Stats.RTT = Peer->ENetPeer->roundTripTime;
+		Stats.PacketLoss = Peer->ENetPeer->packetLoss / (float)ENET_PEER_PACKET_LOSS_SCALE;
+		Stats.QueuedBytes = Peer->ENetPeer->reliableDataInTransit;
+	}
+}
+
+// Halve send rate when reliable data backs up or packets are lost, otherwise grow it, at most once per round trip
+void _ServerNetwork::AdjustSendRate(_Peer *Peer) {
+	_PeerStats &Stats = Peer->Stats;
+	if(Stats.SendRate <= 0.0) {
+		Stats.SendRate = MaxSendRate;
+		Stats.RateTime = Time;
+		return;
+	}
+
+	if(Time - Stats.RateTime < std::max(Stats.RTT / 1000.0, 0.1))
+		return;
+
+	Stats.RateTime = Time;
+	if(Stats.QueuedBytes > CongestionQueuedBytes || Stats.PacketLoss > CongestionPacketLoss)
+		Stats.SendRate = std::max(Stats.SendRate * 0.5, MinSendRate);
+	else
+		Stats.SendRate = std::min(Stats.SendRate + MaxSendRate / 16.0, MaxSendRate);
+}
+
+// Update per peer speeds once a second
+void _ServerNetwork::UpdatePeerStats(double Period) {
+	for(auto &Peer : Peers) {
+		_PeerStats &Stats = Peer->Stats;
+		Stats.SentSpeed = Stats.SecondSentData / Period;
+		Stats.ReceiveSpeed = Stats.SecondReceivedData / Period;
+		Stats.SecondSentData = 0;
+		Stats.SecondReceivedData = 0;
+		RefreshPeerStats(Peer);
+	}
+}
+
+// Add a message to the peer's batch, sending the batch first if the message doesn't fit
+void _ServerNetwork::QueueMessage(const _Buffer &Buffer, _Peer *Peer, SendType Type, uint8_t Channel) {
+	if(!Peer)
+		return;
+
+	if(!PacketHeaders || Peer->Loopback || !Peer->ENetPeer) {
+		SendPacket(Buffer, Peer, Type, Channel);
+		return;
+	}
+
+	// Find batch
+	_MessageBatch *Batch = nullptr;
+	for(auto &PeerBatch : Peer->MessageBatches) {
+		if(PeerBatch.Type == Type && PeerBatch.Channel == Channel) {
+			Batch = &PeerBatch;
+			break;
+		}
+	}
+
+	if(!Batch) {
+		Peer->MessageBatches.push_back({ nullptr, Type, Channel });
+		Batch = &Peer->MessageBatches.back();
+	}
+
+	// Header, length prefix and message must fit within the max size
+	std::size_t Size = Buffer.GetCurrentSize();
+	if(Batch->Data && Batch->Data->GetCurrentSize() + Size + 5 > MaxBatchSize)
+		SendBatch(Peer, *Batch);
+
+	// Send large messages by themselves after anything queued before them
+	if(Size + 6 > MaxBatchSize) {
+		SendPacket(Buffer, Peer, Type, Channel);
+		return;
+	}
+
+	if(!Batch->Data) {
+		Batch->Data = BufferPool.Acquire(MaxBatchSize);
+		Batch->Data->Write<uint8_t>(BATCHED);
+	}
+
+	Batch->Data->WriteVarInt(Size);
+	Batch->Data->WriteData(Buffer.GetData(), Size);
+}
+
+// Send all batched messages
+void _ServerNetwork::FlushMessages() {
+	for(auto &Peer : Peers) {
+		for(auto &Batch : Peer->MessageBatches)
+			SendBatch(Peer, Batch);
+	}
+}
+
+// Send a batch as one packet
+void _ServerNetwork::SendBatch(_Peer *Peer, _MessageBatch &Batch) {
+	if(!Batch.Data)
+		return;
+
+	if(Peer->ENetPeer) {
+		std::size_t Size = Batch.Data->GetCurrentSize();
+		Peer->Stats.SentData += Size;
+		Peer->Stats.SecondSentData += (uint32_t)Size;
+
+		ENetPacket *EPacket = enet_packet_create(Batch.Data->GetData(), Size, (enet_uint32)Batch.Type);
+		SendENetPacket(Peer->ENetPeer, Peer->ConnectID, Batch.Channel, EPacket);
 	}
+
+	BufferPool.Release(Batch.Data);
+	Batch.Data = nullptr;
+}
+
+// Set request prefix and cached reply for pings
+void _ServerNetwork::SetPingResponse(const _Buffer &Request, const _Buffer &Response) {
+	PingRequest.assign(Request.GetData(), Request.GetData() + Request.GetCurrentSize());
+	PingResponse.assign(Response.GetData(), Response.GetData() + Response.GetCurrentSize());
+}
+
+// Check a ping against the request prefix and the sender's rate limit
+bool _ServerNetwork::AcceptPing(const char *Data, std::size_t Size, uint32_t Host) {
+	if(Size < PingRequest.size() || (!PingRequest.empty() && memcmp(Data, PingRequest.data(), PingRequest.size())))
+		return false;
+
+	// Forget idle addresses
+	if(Time - PingCleanTime >= 10.0) {
+		PingCleanTime = Time;
+		for(auto Iterator = PingLimits.begin(); Iterator != PingLimits.end(); ) {
+			if(Time - Iterator->second.Time >= 10.0)
+				Iterator = PingLimits.erase(Iterator);
+			else
+				++Iterator;
+		}
+	}
+
+	// Refill tokens
+	auto Iterator = PingLimits.find(Host);
+	if(Iterator == PingLimits.end())
+		Iterator = PingLimits.insert({ Host, { PingBurst, Time } }).first;
+
+	_PingLimit &Limit = Iterator->second;
+	Limit.Tokens = std::min(Limit.Tokens + (Time - Limit.Time) * PingRate, PingBurst);
+	Limit.Time = Time;
+	if(Limit.Tokens < 1.0)
+		return false;
+
+	Limit.Tokens -= 1.0;
+
+	return true;
+}
+
+// Read all waiting pings and reply with the cached response, returns number of replies
+std::size_t _ServerNetwork::HandlePings() {
+	if(PingSocket == -1 || PingResponse.empty())
+		return 0;
+
+	const std::size_t MAX_PING_SIZE = 512;
+	std::size_t Replies = 0;
+
+#ifdef __linux__
+	const unsigned int BATCH_SIZE = 64;
+	PingBuffer.resize(BATCH_SIZE * MAX_PING_SIZE);
+
+	mmsghdr Messages[BATCH_SIZE];
+	iovec Vectors[BATCH_SIZE];
+	sockaddr_in Addresses[BATCH_SIZE];
+	mmsghdr ReplyMessages[BATCH_SIZE];
+	iovec ReplyVector;
+	ReplyVector.iov_base = PingResponse.data();
+	ReplyVector.iov_len = PingResponse.size();
+
+	while(true) {
+
+		// Receive batch
+		memset(Messages, 0, sizeof(Messages));
+		for(unsigned int i = 0; i < BATCH_SIZE; i++) {
+			Vectors[i].iov_base = &PingBuffer[i * MAX_PING_SIZE];
+			Vectors[i].iov_len = MAX_PING_SIZE;
+			Messages[i].msg_hdr.msg_iov = &Vectors[i];
+			Messages[i].msg_hdr.msg_iovlen = 1;
+			Messages[i].msg_hdr.msg_name = &Addresses[i];
+			Messages[i].msg_hdr.msg_namelen = sizeof(Addresses[i]);
+		}
+
+		int Received = recvmmsg(PingSocket, Messages, BATCH_SIZE, MSG_DONTWAIT, nullptr);
+		if(Received <= 0)
+			break;
+
+		// Build replies
+		unsigned int ReplyCount = 0;
+		memset(ReplyMessages, 0, sizeof(ReplyMessages));
+		for(int i = 0; i < Received; i++) {
+			if(!AcceptPing(&PingBuffer[i * MAX_PING_SIZE], Messages[i].msg_len, Addresses[i].sin_addr.s_addr))
+				continue;
+
+			mmsghdr &Reply = ReplyMessages[ReplyCount++];
+			Reply.msg_hdr.msg_iov = &ReplyVector;
+			Reply.msg_hdr.msg_iovlen = 1;
+			Reply.msg_hdr.msg_name = &Addresses[i];
+			Reply.msg_hdr.msg_namelen = sizeof(Addresses[i]);
+		}
+
+		if(ReplyCount) {
+			int Sent = sendmmsg(PingSocket, ReplyMessages, ReplyCount, MSG_DONTWAIT);
+			if(Sent > 0)
+				Replies += (std::size_t)Sent;
+		}
+
+		if((unsigned int)Received < BATCH_SIZE)
+			break;
+	}
+#else
+	PingBuffer.resize(MAX_PING_SIZE);
+
+	ENetBuffer ReplyBuffer;
+	ReplyBuffer.data = PingResponse.data();
+	ReplyBuffer.dataLength = PingResponse.size();
+
+	while(true) {
+		ENetBuffer SocketBuffer;
+		SocketBuffer.data = PingBuffer.data();
+		SocketBuffer.dataLength = PingBuffer.size();
+
+		ENetAddress Address;
+		int Received = enet_socket_receive(PingSocket, &Address, &SocketBuffer, 1);
+		if(Received <= 0)
+			break;
+
+		if(!AcceptPing(PingBuffer.data(), (std::size_t)Received, Address.host))
+			continue;
+
+		if(enet_socket_send(PingSocket, &Address, &ReplyBuffer, 1) > 0)
+			Replies++;
+	}
+#endif
+
+	return Replies;
 }
 
 }
@@ -21,12 +21,19 @@
 
 // Libraries
 #include <ae/network.h>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace ae {
 
 // Forward Declarations
 class _Buffer;
 class _Peer;
+class _LoopbackHub;
+struct _MessageBatch;
+template<class T> class _SPSCQueue;
 
 class _ServerNetwork : public _Network {
 
@@ -38,6 +45,21 @@ class _ServerNetwork : public _Network {
 		// Sockets
 		void CreatePingSocket(uint16_t Port);
 
+		// Answer server browser pings that start with Request using a cached Response, call again when server info changes.
+		// HandlePings reads every waiting ping and replies in one batch, limited to Rate per second per source address.
+		void SetPingResponse(const _Buffer &Request, const _Buffer &Response);
+		void SetPingRateLimit(double Rate, double Burst) { PingRate = Rate; PingBurst = Burst; }
+		std::size_t HandlePings();
+
+		// Accept in-memory connections from _LoopbackClients. Detaching gives each loopback peer a disconnect event.
+		void AttachLoopback(_LoopbackHub *Hub);
+		void DetachLoopback();
+
+		// Service enet on its own thread
+		void StartThread(uint32_t ServiceTimeout=1);
+		void StopThread();
+		bool IsThreaded() const { return Thread != nullptr; }
+
 		// Connections
 		uint16_t GetListenPort();
 		std::size_t GetMaxPeers();
@@ -47,6 +69,19 @@ class _ServerNetwork : public _Network {
 		// Packets
 		void SendPacket(const _Buffer &Buffer, const _Peer *Peer, SendType Type=RELIABLE, uint8_t Channel=0);
 		void BroadcastPacket(const _Buffer &Buffer, _Peer *ExceptionPeer, SendType Type=RELIABLE, uint8_t Channel=0);
+		void MulticastPacket(const _Buffer &Buffer, const std::vector<_Peer *> &TargetPeers, SendType Type=RELIABLE, uint8_t Channel=0);
+
+		// Small messages are batched per peer, send type and channel until FlushMessages is called, usually once per update tick.
+		// Needs packet headers, otherwise messages are sent right away.
+		void QueueMessage(const _Buffer &Buffer, _Peer *Peer, SendType Type=RELIABLE, uint8_t Channel=0);
+		void FlushMessages();
+		void SetMaxBatchSize(std::size_t Value) { MaxBatchSize = Value; }
+
+		// Unreliable updates are queued per peer and sent by priority within each peer's send rate
+		void QueueUpdate(const _Buffer &Buffer, _Peer *Peer, float Priority=1.0f, uint8_t Channel=0);
+		void SendUpdates();
+		void SetUpdateRates(double MinRate, double MaxRate) { MinSendRate = MinRate; MaxSendRate = MaxRate; }
+		void SetCongestionLimits(uint32_t QueuedBytes, float PacketLoss) { CongestionQueuedBytes = QueuedBytes; CongestionPacketLoss = PacketLoss; }
 
 		// Peers
 		const std::list<_Peer *> &GetPeers() const { return Peers; }
@@ -54,14 +89,106 @@ class _ServerNetwork : public _Network {
 
 	private:
 
+		// Request from the game thread to the network thread
+		// Ping tokens for one address
+		struct _PingLimit {
+			double Tokens;
+			double Time;
+		};
+
+		// Peer stats copied out of enet by the network thread
+		struct _ThreadPeerStats {
+			std::atomic<uint32_t> RTT;
+			std::atomic<uint32_t> PacketLoss;
+			std::atomic<uint32_t> QueuedBytes;
+		};
+
+		struct _Command {
+			enum CommandType {
+				SEND,
+				SEND_SHARED,
+				RELEASE,
+				DISCONNECT,
+				RESET,
+			};
+
+			CommandType Type;
+			_ENetPeer *ENetPeer;
+			uint32_t ConnectID;
+			ENetPacket *Packet;
+			uint8_t Channel;
+			int Data;
+		};
+
 		void CreateEvent(_NetworkEvent &Event, double EventTime, ENetEvent &EEvent) override;
 		void HandleEvent(_NetworkEvent &Event, ENetEvent &EEvent) override;
+		bool GetENetEvent(ENetEvent &EEvent) override;
+		void TakeDataTotals(uint32_t &SentData, uint32_t &ReceivedData) override;
+		void DeliverPacket(_ENetPeer *ENetPeer, uint32_t ConnectID, uint8_t Channel, ENetPacket *Packet) override;
+		void ReceiveLoopbackEvents() override;
+		void UpdatePeerStats(double Period) override;
+
+		// Stats
+		void RefreshPeerStats(_Peer *Peer);
+		void AdjustSendRate(_Peer *Peer);
+
+		// Threading
+		static void RunThread(_ServerNetwork *ServerNetwork);
+		void QueueCommand(_Command::CommandType Type, _ENetPeer *ENetPeer, uint32_t ConnectID, ENetPacket *Packet=nullptr, uint8_t Channel=0, int Data=0);
+		void RunCommand(const _Command &Command);
+		void FlushCommands();
+		static void DiscardENetEvent(ENetEvent &EEvent);
 
 		// Delete peers and empty list
 		void ClearPeers();
 
+		// Batching
+		void SendBatch(_Peer *Peer, _MessageBatch &Batch);
+
+		// Pings
+		bool AcceptPing(const char *Data, std::size_t Size, uint32_t Host);
+
+		// Shared packets
+		void SendSharedPacket(ENetPacket *&EPacket, const _Buffer &Buffer, const _Peer *Peer, SendType Type, uint8_t Channel);
+		void FreeSharedPacket(ENetPacket *EPacket);
+
 		// Peers
 		std::list<_Peer *> Peers;
+
+		// Send scheduling in bytes per second
+		double MinSendRate;
+		double MaxSendRate;
+		uint32_t CongestionQueuedBytes;
+		float CongestionPacketLoss;
+		double LastUpdatesTime;
+
+		// Largest batched packet in bytes
+		std::size_t MaxBatchSize;
+
+		// Pings
+		std::vector<char> PingRequest;
+		std::vector<char> PingResponse;
+		std::vector<char> PingBuffer;
+		std::unordered_map<uint32_t, _PingLimit> PingLimits;
+		double PingRate;
+		double PingBurst;
+		double PingCleanTime;
+
+		// Loopback
+		_LoopbackHub *LoopbackHub;
+		uint32_t LoopbackSentData;
+		uint32_t LoopbackReceivedData;
+
+		// Threading
+		std::thread *Thread;
+		std::atomic<bool> ThreadDone;
+		uint32_t ServiceTimeout;
+		_SPSCQueue<ENetEvent> *InboundEvents;
+		_SPSCQueue<_Command> *Commands;
+		std::vector<_Command> OverflowCommands;
+		std::atomic<uint32_t> ThreadSentData;
+		std::atomic<uint32_t> ThreadReceivedData;
+		_ThreadPeerStats *ThreadPeerStats;
 };
 
 }
@@ -0,0 +1,297 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#include <ae/snapshot.h>
+#include <ae/buffer.h>
+#include <ae/peer.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace ae {
+
+// Append an object's state
+void _Snapshot::Add(NetworkIDType ID, const void *EntryData, uint16_t Size) {
+	Entries.push_back(_SnapshotEntry(ID, (uint32_t)Data.size(), Size));
+	Data.insert(Data.end(), (const uint8_t *)EntryData, (const uint8_t *)EntryData + Size);
+}
+
+// Sort entries by id
+void _Snapshot::Sort() {
+	std::sort(Entries.begin(), Entries.end(), [](const _SnapshotEntry &A, const _SnapshotEntry &B) {
+		return A.ID < B.ID;
+	});
+}
+
+// Remove all entries, keeping memory
+void _Snapshot::Clear() {
+	Entries.clear();
+	Data.clear();
+}
+
+// Find entry by id
+const _SnapshotEntry *_Snapshot::Find(NetworkIDType ID) const {
+	auto Iterator = std::lower_bound(Entries.begin(), Entries.end(), ID, [](const _SnapshotEntry &Entry, NetworkIDType Value) {
+		return Entry.ID < Value;
+	});
+	if(Iterator == Entries.end() || Iterator->ID != ID)
+		return nullptr;
+
+	return &(*Iterator);
+}
+
+// Constructor
+_SnapshotHistory::_SnapshotHistory(int Size) :
+	Snapshots(Size),
+	NextSequence(1) {
+
+}
+
+// Start a new snapshot, sequence 0 is skipped so a zero ack means nothing was received
+_Snapshot &_SnapshotHistory::Add() {
+	_Snapshot &Snapshot = Add(NextSequence);
+
+	NextSequence++;
+	if(!NextSequence)
+		NextSequence = 1;
+
+	return Snapshot;
+}
+
+// Start a snapshot with a given sequence
+_Snapshot &_SnapshotHistory::Add(uint16_t Sequence) {
+	_Snapshot &Snapshot = Snapshots.PushBack();
+	Snapshot.Clear();
+	Snapshot.Sequence = Sequence;
+
+	return Snapshot;
+}
+
+// Find snapshot by sequence
+const _Snapshot *_SnapshotHistory::Get(uint16_t Sequence) const {
+	for(int i = 0; i < Snapshots.Size(); i++) {
+		const _Snapshot &Snapshot = Snapshots.Back(i);
+		if(Snapshot.Sequence == Sequence)
+			return &Snapshot;
+	}
+
+	return nullptr;
+}
+
+// Get the last snapshot a peer acknowledged
+const _Snapshot *_SnapshotHistory::GetBase(const _Peer *Peer) const {
+	if(!Peer || !Peer->LastAck)
+		return nullptr;
+
+	return Get(Peer->LastAck);
+}
+
+// Write the difference between two snapshots.
+// Format: sequence, base flag and sequence, removed ids, then changed entries. Counts, sizes and ids are bit packed varints, ids are sent as the gap from the previous id.
+// Changed entries have a bit mask of modified bytes, new entries are sent whole.
+void _SnapshotHistory::WriteDelta(_Buffer &Buffer, const _Snapshot &Current, const _Snapshot *Base) {
+	static const _Snapshot Empty;
+	if(!Base)
+		Base = &Empty;
+
+	// Header
+	Buffer.Write<uint16_t>(Current.Sequence);
+	Buffer.WriteBit(Base != &Empty);
+	if(Base != &Empty)
+		Buffer.WriteBits(Base->Sequence, 16);
+
+	// Count removed and changed entries
+	std::size_t RemovedCount = 0;
+	std::size_t ChangedCount = 0;
+	std::size_t BaseIndex = 0;
+	for(const auto &Entry : Current.Entries) {
+		while(BaseIndex < Base->Entries.size() && Base->Entries[BaseIndex].ID < Entry.ID) {
+			RemovedCount++;
+			BaseIndex++;
+		}
+
+		// Compare with base entry
+		if(BaseIndex < Base->Entries.size() && Base->Entries[BaseIndex].ID == Entry.ID) {
+			const _SnapshotEntry &BaseEntry = Base->Entries[BaseIndex++];
+			if(BaseEntry.Size == Entry.Size && !memcmp(Base->GetEntryData(BaseEntry), Current.GetEntryData(Entry), Entry.Size))
+				continue;
+		}
+
+		ChangedCount++;
+	}
+	RemovedCount += Base->Entries.size() - BaseIndex;
+
+	// Write removed ids
+	Buffer.WriteVarInt(RemovedCount);
+	std::size_t CurrentIndex = 0;
+	NetworkIDType PreviousID = 0;
+	for(const auto &BaseEntry : Base->Entries) {
+		while(CurrentIndex < Current.Entries.size() && Current.Entries[CurrentIndex].ID < BaseEntry.ID)
+			CurrentIndex++;
+
+		if(CurrentIndex == Current.Entries.size() || Current.Entries[CurrentIndex].ID != BaseEntry.ID) {
+			Buffer.WriteVarInt(BaseEntry.ID - PreviousID);
+			PreviousID = BaseEntry.ID;
+		}
+	}
+
+	// Write changed entries
+	Buffer.WriteVarInt(ChangedCount);
+	BaseIndex = 0;
+	PreviousID = 0;
+	for(const auto &Entry : Current.Entries) {
+		while(BaseIndex < Base->Entries.size() && Base->Entries[BaseIndex].ID < Entry.ID)
+			BaseIndex++;
+
+		const uint8_t *EntryData = Current.GetEntryData(Entry);
+		const _SnapshotEntry *BaseEntry = nullptr;
+		if(BaseIndex < Base->Entries.size() && Base->Entries[BaseIndex].ID == Entry.ID)
+			BaseEntry = &Base->Entries[BaseIndex++];
+
+		// Send whole entry if it's new or changed size
+		if(!BaseEntry || BaseEntry->Size != Entry.Size) {
+			Buffer.WriteVarInt(Entry.ID - PreviousID);
+			Buffer.WriteBit(true);
+			Buffer.WriteVarInt(Entry.Size);
+			Buffer.WriteData(EntryData, Entry.Size);
+			PreviousID = Entry.ID;
+
+			continue;
+		}
+
+		// Skip unchanged entries
+		const uint8_t *BaseData = Base->GetEntryData(*BaseEntry);
+		if(!memcmp(BaseData, EntryData, Entry.Size))
+			continue;
+
+		// Write change mask then changed bytes, all bit packed
+		Buffer.WriteVarInt(Entry.ID - PreviousID);
+		Buffer.WriteBit(false);
+		PreviousID = Entry.ID;
+		for(uint16_t i = 0; i < Entry.Size; i++)
+			Buffer.WriteBit(BaseData[i] != EntryData[i]);
+		for(uint16_t i = 0; i < Entry.Size; i++) {
+			if(BaseData[i] != EntryData[i])
+				Buffer.WriteBits(EntryData[i], 8);
+		}
+	}
+}
+
+// Read a delta and add the result to the history. Returns null if the base snapshot isn't available.
+const _Snapshot *_SnapshotHistory::ReadDelta(_Buffer &Buffer) {
+	static const _Snapshot Empty;
+
+	// Header
+	uint16_t Sequence = Buffer.Read<uint16_t>();
+	const _Snapshot *Base = &Empty;
+	if(Buffer.ReadBit()) {
+		Base = Get((uint16_t)Buffer.ReadBits(16));
+		if(!Base)
+			return nullptr;
+	}
+
+	// Read removed ids, only base entries can be removed
+	uint64_t RemovedCount = Buffer.ReadVarInt();
+	if(Buffer.HasError() || RemovedCount > Base->Entries.size())
+		return nullptr;
+
+	std::vector<NetworkIDType> Removed((std::size_t)RemovedCount);
+	NetworkIDType PreviousID = 0;
+	for(auto &ID : Removed) {
+		ID = PreviousID + (NetworkIDType)Buffer.ReadVarInt();
+		PreviousID = ID;
+	}
+
+	// Merge base with changed entries
+	Scratch.Clear();
+	Scratch.Sequence = Sequence;
+	std::vector<uint8_t> Mask;
+	std::size_t BaseIndex = 0;
+	std::size_t RemovedIndex = 0;
+	uint64_t ChangedCount = Buffer.ReadVarInt();
+	if(Buffer.HasError() || ChangedCount > (uint64_t)std::numeric_limits<NetworkIDType>::max() + 1)
+		return nullptr;
+
+	PreviousID = 0;
+	for(uint64_t i = 0; i <= ChangedCount; i++) {
+		if(Buffer.HasError())
+			return nullptr;
+
+		// Copy base entries before the next changed id
+		bool Last = i == ChangedCount;
+		NetworkIDType ID = Last ? 0 : PreviousID + (NetworkIDType)Buffer.ReadVarInt();
+		PreviousID = ID;
+		while(BaseIndex < Base->Entries.size() && (Last || Base->Entries[BaseIndex].ID < ID)) {
+			const _SnapshotEntry &BaseEntry = Base->Entries[BaseIndex++];
+			while(RemovedIndex < Removed.size() && Removed[RemovedIndex] < BaseEntry.ID)
+				RemovedIndex++;
+
+			if(RemovedIndex == Removed.size() || Removed[RemovedIndex] != BaseEntry.ID)
+				Scratch.Add(BaseEntry.ID, Base->GetEntryData(BaseEntry), BaseEntry.Size);
+		}
+		if(Last)
+			break;
+
+		// Get matching base entry
+		const _SnapshotEntry *BaseEntry = nullptr;
+		if(BaseIndex < Base->Entries.size() && Base->Entries[BaseIndex].ID == ID)
+			BaseEntry = &Base->Entries[BaseIndex++];
+
+		// Read whole entry
+		if(Buffer.ReadBit()) {
+			uint64_t Size = Buffer.ReadVarInt();
+			if(Buffer.HasError() || Size > std::numeric_limits<uint16_t>::max() || Size > Buffer.GetRemainingSize())
+				return nullptr;
+
+			Scratch.Entries.push_back(_SnapshotEntry(ID, (uint32_t)Scratch.Data.size(), (uint16_t)Size));
+			Scratch.Data.resize(Scratch.Data.size() + (std::size_t)Size);
+			if(Size && !Buffer.ReadData(&Scratch.Data[Scratch.Entries.back().Offset], (std::size_t)Size))
+				return nullptr;
+
+			continue;
+		}
+
+		// Patch base entry using change mask
+		if(!BaseEntry)
+			return nullptr;
+
+		Scratch.Add(ID, Base->GetEntryData(*BaseEntry), BaseEntry->Size);
+		uint8_t *EntryData = &Scratch.Data[Scratch.Entries.back().Offset];
+		Mask.resize(BaseEntry->Size);
+		for(uint16_t j = 0; j < BaseEntry->Size; j++)
+			Mask[j] = Buffer.ReadBit();
+		for(uint16_t j = 0; j < BaseEntry->Size; j++) {
+			if(Mask[j])
+				EntryData[j] = (uint8_t)Buffer.ReadBits(8);
+		}
+	}
+
+	if(Buffer.HasError())
+		return nullptr;
+
+	// Move result into history
+	_Snapshot &Snapshot = Add(Sequence);
+	std::swap(Snapshot.Entries, Scratch.Entries);
+	std::swap(Snapshot.Data, Scratch.Data);
+
+	return &Snapshot;
+}
+
+}
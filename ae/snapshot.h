@@ -0,0 +1,95 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ae/type.h>
+#include <ae/circular_buffer.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace ae {
+
+// Forward Declarations
+class _Buffer;
+class _Peer;
+
+// Serialized state of one object
+struct _SnapshotEntry {
+	_SnapshotEntry() : ID(0), Offset(0), Size(0) { }
+	_SnapshotEntry(NetworkIDType ID, uint32_t Offset, uint16_t Size) : ID(ID), Offset(Offset), Size(Size) { }
+
+	NetworkIDType ID;
+	uint32_t Offset;
+	uint16_t Size;
+};
+
+// State of all replicated objects at one point in time
+class _Snapshot {
+
+	public:
+
+		_Snapshot() : Sequence(0) { }
+
+		// Entries must be added in increasing id order, or Sort called afterwards
+		void Add(NetworkIDType ID, const void *EntryData, uint16_t Size);
+		void Sort();
+		void Clear();
+
+		const _SnapshotEntry *Find(NetworkIDType ID) const;
+		const uint8_t *GetEntryData(const _SnapshotEntry &Entry) const { return &Data[Entry.Offset]; }
+
+		uint16_t Sequence;
+		std::vector<_SnapshotEntry> Entries;
+		std::vector<uint8_t> Data;
+
+};
+
+// Ring of recent snapshots used as delta bases
+class _SnapshotHistory {
+
+	public:
+
+		_SnapshotHistory(int Size=32);
+
+		// Start a new snapshot with the next sequence number, reusing the oldest slot's memory
+		_Snapshot &Add();
+
+		// Start a snapshot with a received sequence number
+		_Snapshot &Add(uint16_t Sequence);
+
+		const _Snapshot *Get(uint16_t Sequence) const;
+		const _Snapshot *GetBase(const _Peer *Peer) const;
+		void Clear() { Snapshots.Clear(); }
+
+		// Delta encoding, a null base writes the full snapshot
+		static void WriteDelta(_Buffer &Buffer, const _Snapshot &Current, const _Snapshot *Base);
+		const _Snapshot *ReadDelta(_Buffer &Buffer);
+
+	private:
+
+		_CircularBuffer<_Snapshot> Snapshots;
+		_Snapshot Scratch;
+		uint16_t NextSequence;
+
+};
+
+}
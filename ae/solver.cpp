@@ -0,0 +1,252 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#include <ae/solver.h>
+#include <ae/jobs.h>
+#include <glm/geometric.hpp>
+#include <algorithm>
+
+namespace ae {
+
+// Apply an impulse to a body, static bodies are never written so islands can share them
+static inline void ApplyImpulse(float InverseMass, glm::vec2 &Velocity, const glm::vec2 &Impulse) {
+	if(InverseMass > 0.0f)
+		Velocity += Impulse * InverseMass;
+}
+
+// Constructor
+_ContactSolver::_ContactSolver(const _ContactSolverSettings &Settings) :
+	Settings(Settings) {
+
+}
+
+// Resolve contacts
+void _ContactSolver::Solve(const std::vector<_Manifold> &Manifolds, GetBodyFunction GetBody, _JobSystem *Jobs) {
+	Bodies.clear();
+	Contacts.clear();
+	IslandStarts.clear();
+	BodyIndex.clear();
+	Stats = _ContactSolverStats();
+
+	// Build contacts
+	for(const auto &Manifold : Manifolds) {
+		_RigidBody *BodyA = GetBody ? GetBody(Manifold.ObjectA) : (_RigidBody *)Manifold.ObjectA;
+		_RigidBody *BodyB = GetBody ? GetBody(Manifold.ObjectB) : (_RigidBody *)Manifold.ObjectB;
+		if(!BodyA || !BodyB || BodyA == BodyB)
+			continue;
+		if(!BodyA->CollisionResponse || !BodyB->CollisionResponse)
+			continue;
+		if(BodyA->InverseMass + BodyB->InverseMass <= 0.0f)
+			continue;
+
+		_Contact Contact;
+		Contact.ObjectA = Manifold.ObjectA;
+		Contact.ObjectB = Manifold.ObjectB;
+		Contact.BodyA = AddBody(BodyA);
+		Contact.BodyB = AddBody(BodyB);
+		Contact.Island = -1;
+		Contact.Normal = Manifold.Normal;
+		Contact.Penetration = Manifold.Penetration;
+		Contact.Mass = 1.0f / (BodyA->InverseMass + BodyB->InverseMass);
+		Contact.NormalImpulse = 0.0f;
+		Contact.TangentImpulse = 0.0f;
+
+		// Bounce only when closing fast enough
+		float ClosingSpeed = glm::dot(BodyB->Velocity - BodyA->Velocity, Manifold.Normal);
+		Contact.Bounce = ClosingSpeed < -Settings.RestitutionThreshold ? -std::min(BodyA->Restitution, BodyB->Restitution) * ClosingSpeed : 0.0f;
+
+		// Start from last frame's impulses if the contact hasn't turned
+		const auto &Iterator = Cache.find(std::make_pair(Manifold.ObjectA, Manifold.ObjectB));
+		if(Iterator != Cache.end() && glm::dot(Iterator->second.Normal, Manifold.Normal) > 0.95f) {
+			Contact.NormalImpulse = Iterator->second.NormalImpulse;
+			Contact.TangentImpulse = Iterator->second.TangentImpulse;
+			Stats.WarmStarted++;
+		}
+
+		// Join islands through dynamic bodies
+		if(BodyA->InverseMass > 0.0f && BodyB->InverseMass > 0.0f) {
+			int RootA = FindRoot(Contact.BodyA);
+			int RootB = FindRoot(Contact.BodyB);
+			if(RootA != RootB)
+				Bodies[RootA].Parent = RootB;
+		}
+
+		Contacts.push_back(Contact);
+	}
+
+	if(Contacts.empty()) {
+		Cache.clear();
+		return;
+	}
+
+	// Number islands in order of first contact
+	std::vector<int> RootIslands(Bodies.size(), -1);
+	std::vector<std::size_t> IslandSizes;
+	for(auto &Contact : Contacts) {
+		int Root = FindRoot(Bodies[Contact.BodyA].InverseMass > 0.0f ? Contact.BodyA : Contact.BodyB);
+		if(RootIslands[Root] == -1) {
+			RootIslands[Root] = (int)IslandSizes.size();
+			IslandSizes.push_back(0);
+		}
+
+		Contact.Island = RootIslands[Root];
+		IslandSizes[Contact.Island]++;
+	}
+
+	// Group contacts by island, keeping their order
+	IslandStarts.resize(IslandSizes.size() + 1, 0);
+	for(std::size_t i = 0; i < IslandSizes.size(); i++) {
+		IslandStarts[i + 1] = IslandStarts[i] + IslandSizes[i];
+		Stats.LargestIsland = std::max(Stats.LargestIsland, IslandSizes[i]);
+	}
+
+	std::vector<std::size_t> Offsets(IslandStarts.begin(), IslandStarts.end() - 1);
+	std::vector<_Contact> Sorted(Contacts.size());
+	for(const auto &Contact : Contacts)
+		Sorted[Offsets[Contact.Island]++] = Contact;
+	Contacts.swap(Sorted);
+
+	// Solve islands
+	std::size_t IslandCount = IslandSizes.size();
+	if(Jobs && IslandCount > 1 && Contacts.size() >= Settings.ParallelThreshold) {
+		Jobs->ParallelFor(IslandCount, 1, [this](std::size_t Start, std::size_t End) {
+			for(std::size_t i = Start; i < End; i++)
+				SolveIsland(i);
+		});
+	}
+	else {
+		for(std::size_t i = 0; i < IslandCount; i++)
+			SolveIsland(i);
+	}
+
+	// Write back dynamic bodies
+	for(const auto &SolverBody : Bodies) {
+		if(SolverBody.InverseMass <= 0.0f)
+			continue;
+
+		SolverBody.Body->Velocity = SolverBody.Velocity;
+		SolverBody.Body->Position += SolverBody.Correction;
+	}
+
+	// Keep impulses for next frame
+	Cache.clear();
+	for(const auto &Contact : Contacts) {
+		_CachedImpulse &CachedImpulse = Cache[std::make_pair(Contact.ObjectA, Contact.ObjectB)];
+		CachedImpulse.Normal = Contact.Normal;
+		CachedImpulse.NormalImpulse = Contact.NormalImpulse;
+		CachedImpulse.TangentImpulse = Contact.TangentImpulse;
+	}
+
+	Stats.Contacts = Contacts.size();
+	Stats.Islands = IslandCount;
+}
+
+// Get solver index for a body, adding it if needed
+int _ContactSolver::AddBody(_RigidBody *Body) {
+	const auto &Iterator = BodyIndex.find(Body);
+	if(Iterator != BodyIndex.end())
+		return Iterator->second;
+
+	int Index = (int)Bodies.size();
+	_SolverBody SolverBody;
+	SolverBody.Body = Body;
+	SolverBody.Velocity = Body->Velocity;
+	SolverBody.Correction = glm::vec2(0.0f, 0.0f);
+	SolverBody.InverseMass = Body->InverseMass;
+	SolverBody.Parent = Index;
+	Bodies.push_back(SolverBody);
+	BodyIndex[Body] = Index;
+
+	return Index;
+}
+
+// Find island root with path halving
+int _ContactSolver::FindRoot(int Index) {
+	while(Bodies[Index].Parent != Index) {
+		Bodies[Index].Parent = Bodies[Bodies[Index].Parent].Parent;
+		Index = Bodies[Index].Parent;
+	}
+
+	return Index;
+}
+
+// Solve contacts in one island
+void _ContactSolver::SolveIsland(std::size_t Island) {
+	std::size_t Begin = IslandStarts[Island];
+	std::size_t End = IslandStarts[Island + 1];
+
+	// Warm start
+	for(std::size_t i = Begin; i < End; i++) {
+		_Contact &Contact = Contacts[i];
+		_SolverBody &A = Bodies[Contact.BodyA];
+		_SolverBody &B = Bodies[Contact.BodyB];
+		glm::vec2 Tangent(-Contact.Normal.y, Contact.Normal.x);
+		glm::vec2 Impulse = Contact.Normal * Contact.NormalImpulse + Tangent * Contact.TangentImpulse;
+		ApplyImpulse(A.InverseMass, A.Velocity, -Impulse);
+		ApplyImpulse(B.InverseMass, B.Velocity, Impulse);
+	}
+
+	// Velocity iterations
+	for(int Iteration = 0; Iteration < Settings.VelocityIterations; Iteration++) {
+		for(std::size_t i = Begin; i < End; i++) {
+			_Contact &Contact = Contacts[i];
+			_SolverBody &A = Bodies[Contact.BodyA];
+			_SolverBody &B = Bodies[Contact.BodyB];
+
+			// Friction is limited by the normal impulse
+			if(Settings.Friction > 0.0f) {
+				glm::vec2 Tangent(-Contact.Normal.y, Contact.Normal.x);
+				float Lambda = -glm::dot(B.Velocity - A.Velocity, Tangent) * Contact.Mass;
+				float Limit = Settings.Friction * Contact.NormalImpulse;
+				float OldImpulse = Contact.TangentImpulse;
+				Contact.TangentImpulse = std::min(std::max(OldImpulse + Lambda, -Limit), Limit);
+				glm::vec2 Impulse = Tangent * (Contact.TangentImpulse - OldImpulse);
+				ApplyImpulse(A.InverseMass, A.Velocity, -Impulse);
+				ApplyImpulse(B.InverseMass, B.Velocity, Impulse);
+			}
+
+			// Accumulated normal impulse never pulls bodies together
+			float Lambda = (Contact.Bounce - glm::dot(B.Velocity - A.Velocity, Contact.Normal)) * Contact.Mass;
+			float OldImpulse = Contact.NormalImpulse;
+			Contact.NormalImpulse = std::max(OldImpulse + Lambda, 0.0f);
+			glm::vec2 Impulse = Contact.Normal * (Contact.NormalImpulse - OldImpulse);
+			ApplyImpulse(A.InverseMass, A.Velocity, -Impulse);
+			ApplyImpulse(B.InverseMass, B.Velocity, Impulse);
+		}
+	}
+
+	// Position iterations push bodies apart without adding velocity
+	for(int Iteration = 0; Iteration < Settings.PositionIterations; Iteration++) {
+		for(std::size_t i = Begin; i < End; i++) {
+			const _Contact &Contact = Contacts[i];
+			_SolverBody &A = Bodies[Contact.BodyA];
+			_SolverBody &B = Bodies[Contact.BodyB];
+			float Penetration = Contact.Penetration - glm::dot(B.Correction - A.Correction, Contact.Normal);
+			float Amount = Settings.Correction * std::max(Penetration - Settings.Slop, 0.0f) * Contact.Mass;
+			if(Amount <= 0.0f)
+				continue;
+
+			glm::vec2 Correction = Contact.Normal * Amount;
+			ApplyImpulse(A.InverseMass, A.Correction, -Correction);
+			ApplyImpulse(B.InverseMass, B.Correction, Correction);
+		}
+	}
+}
+
+}
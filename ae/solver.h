@@ -0,0 +1,146 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <ae/physics.h>
+#include <glm/vec2.hpp>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+namespace ae {
+
+// Forward Declarations
+class _JobSystem;
+
+// Contact solver tuning
+struct _ContactSolverSettings {
+	_ContactSolverSettings() :
+		VelocityIterations(8),
+		PositionIterations(3),
+		Slop(0.01f),
+		Correction(0.8f),
+		Friction(0.0f),
+		RestitutionThreshold(1.0f),
+		ParallelThreshold(64) { }
+
+	int VelocityIterations;
+	int PositionIterations;
+
+	// Penetration allowed before positions are corrected
+	float Slop;
+
+	// Fraction of penetration removed per position iteration
+	float Correction;
+
+	// Coulomb friction along the contact tangent
+	float Friction;
+
+	// Closing speed below which contacts don't bounce
+	float RestitutionThreshold;
+
+	// Contacts needed before islands are solved on the job system
+	std::size_t ParallelThreshold;
+};
+
+// Counts from the last Solve
+struct _ContactSolverStats {
+	_ContactSolverStats() : Contacts(0), Islands(0), LargestIsland(0), WarmStarted(0) { }
+
+	std::size_t Contacts;
+	std::size_t Islands;
+	std::size_t LargestIsland;
+	std::size_t WarmStarted;
+};
+
+// Sequential impulse solver for _Manifold lists
+class _ContactSolver {
+
+	public:
+
+		// Map a manifold object to its body, objects are _RigidBody pointers when null
+		typedef _RigidBody *(*GetBodyFunction)(void *Object);
+
+		_ContactSolver(const _ContactSolverSettings &Settings=_ContactSolverSettings());
+
+		// Resolve contacts by changing body velocities and positions, islands run on Jobs if set
+		void Solve(const std::vector<_Manifold> &Manifolds, GetBodyFunction GetBody=nullptr, _JobSystem *Jobs=nullptr);
+
+		// Forget impulses used for warm starting
+		void Clear() { Cache.clear(); }
+
+		const _ContactSolverStats &GetStats() const { return Stats; }
+
+		_ContactSolverSettings Settings;
+
+	private:
+
+		// Body state used while solving
+		struct _SolverBody {
+			_RigidBody *Body;
+			glm::vec2 Velocity;
+			glm::vec2 Correction;
+			float InverseMass;
+			int Parent;
+		};
+
+		// Contact between two solver bodies
+		struct _Contact {
+			void *ObjectA;
+			void *ObjectB;
+			int BodyA;
+			int BodyB;
+			int Island;
+			glm::vec2 Normal;
+			float Penetration;
+			float Mass;
+			float Bounce;
+			float NormalImpulse;
+			float TangentImpulse;
+		};
+
+		// Impulses kept between frames
+		struct _CachedImpulse {
+			glm::vec2 Normal;
+			float NormalImpulse;
+			float TangentImpulse;
+		};
+
+		struct _PairHash {
+			std::size_t operator()(const std::pair<void *, void *> &Pair) const { return std::hash<void *>()(Pair.first) ^ (std::hash<void *>()(Pair.second) * 31); }
+		};
+
+		int AddBody(_RigidBody *Body);
+		int FindRoot(int Index);
+		void SolveIsland(std::size_t Island);
+
+		std::vector<_SolverBody> Bodies;
+		std::vector<_Contact> Contacts;
+		std::vector<std::size_t> IslandStarts;
+		std::unordered_map<_RigidBody *, int> BodyIndex;
+		std::unordered_map<std::pair<void *, void *>, _CachedImpulse, _PairHash> Cache;
+		_ContactSolverStats Stats;
+
+};
+
+}
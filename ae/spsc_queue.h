@@ -0,0 +1,86 @@
+/******************************************************************************
+* Copyright (c) 2021 Alan Witkowski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+*    misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*******************************************************************************/
+#pragma once
+
+// Libraries
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace ae {
+
+// Lock-free queue for one producer thread and one consumer thread
+template<class T> class _SPSCQueue {
+
+	public:
+
+		// Constructor, size is rounded up to a power of two
+		_SPSCQueue(std::size_t Size) : Head(0), Tail(0) {
+			std::size_t Capacity = 1;
+			while(Capacity < Size)
+				Capacity <<= 1;
+
+			Data.resize(Capacity);
+			Mask = Capacity - 1;
+		}
+
+		// Add to back of queue from the producer, returns false if full
+		bool Push(const T &Value) {
+			std::size_t CurrentTail = Tail.load(std::memory_order_relaxed);
+			if(CurrentTail - Head.load(std::memory_order_acquire) > Mask)
+				return false;
+
+			Data[CurrentTail & Mask] = Value;
+			Tail.store(CurrentTail + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		// Remove front of queue from the consumer, returns false if empty
+		bool Pop(T &Value) {
+			std::size_t CurrentHead = Head.load(std::memory_order_relaxed);
+			if(CurrentHead == Tail.load(std::memory_order_acquire))
+				return false;
+
+			Value = Data[CurrentHead & Mask];
+			Head.store(CurrentHead + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		// Check if queue is empty, only exact from the consumer
+		bool IsEmpty() const {
+			return Head.load(std::memory_order_acquire) == Tail.load(std::memory_order_acquire);
+		}
+
+	private:
+
+		std::vector<T> Data;
+		std::size_t Mask;
+
+		// Keep indices on separate cache lines
+		char HeadPadding[64];
+		std::atomic<std::size_t> Head;
+		char TailPadding[64];
+		std::atomic<std::size_t> Tail;
+
+};
+
+}